@@ -0,0 +1,320 @@
+// Synthetic data.json generator for scale testing. Sets per user and cards
+// per set follow Zipf distributions, so most libraries are small and a few
+// are huge; text lengths follow what students type, including the rare card
+// whose back is a pasted page of notes. Every user's password is the same
+// (--password), so the load generator or a browser can log in as anyone.
+//
+// Build and run from backend/:
+//
+//   g++ -std=c++17 -O2 -Iinclude -Isrc bench/dataset_gen.cpp -pthread -o dataset_gen
+//   ./dataset_gen --users 100000 --out data.json
+//   ./dataset_gen --users 20000 --max-sets 200 --max-cards 2000 --zipf 0.8 --long-back-rate 0.01
+//
+// Users are generated in chunks on every core and each chunk is rendered to
+// JSON text directly, then written to disk in order as soon as it is ready;
+// only a few chunks are held in memory at once, so output size is bounded by
+// the disk, not RAM. Apart from the password salt, output is a pure
+// function of the options and --seed.
+#define FLIPIT_NO_MAIN
+#include "server.cpp"
+
+namespace {
+
+const size_t USERS_PER_CHUNK = 256;
+const size_t CHUNKS_IN_FLIGHT_PER_THREAD = 4;
+
+struct Options {
+    size_t users = 1000;
+    size_t max_sets = 50;       // Zipf over 1..max_sets per user
+    size_t max_cards = 500;     // Zipf over 1..max_cards per set
+    double zipf = 1.0;          // exponent; 0 is uniform
+    double long_back_rate = 0.001;
+    size_t long_back_bytes = 64 * 1024;
+    double clone_rate = 0.02;   // sets that share another set's cards
+    std::string password = "password";
+    uint64_t seed = 42;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string out_path = DATA_FILE;
+};
+
+const char* WORDS[] = {
+    "cell", "membrane", "protein", "energy", "reaction", "theory", "river", "empire", "verb", "noun",
+    "equation", "function", "gradient", "treaty", "climate", "enzyme", "molecule", "atom", "language",
+    "history", "pressure", "current", "vector", "matrix", "nucleus", "orbit", "photosynthesis", "revolution",
+    "integral", "derivative", "dynasty", "constitution", "mitochondria", "oxidation", "velocity", "momentum",
+    "sonnet", "metaphor", "subjunctive", "conjugation", "parliament", "glacier", "tectonic", "isotope",
+    "catalyst", "probability", "hypothesis", "the", "of", "and", "a", "to", "in", "is", "that", "for", "by"};
+const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+const char* TAGS[] = {"biology", "chemistry", "physics", "history", "geography", "language", "literature",
+                      "math", "exam", "review", "hard", "vocab", "finals", "midterm"};
+const size_t TAG_COUNT = sizeof(TAGS) / sizeof(TAGS[0]);
+
+// Weights 1/k^s for k = 1..n, drawn in O(1) through an alias table.
+class Zipf {
+public:
+    Zipf(size_t n, double s) {
+        std::vector<double> weights(n);
+        for (size_t k = 1; k <= n; k++) weights[k - 1] = 1.0 / std::pow(static_cast<double>(k), s);
+        table_ = AliasTable(weights);
+    }
+
+    template <typename Rng>
+    size_t sample(Rng& rng) const { return table_.sample(rng) + 1; }
+
+private:
+    AliasTable table_;
+};
+
+class Generator {
+public:
+    Generator(const Options& opt, std::string password_hash)
+        : opt_(opt), sets_(opt.max_sets, opt.zipf), cards_(opt.max_cards, opt.zipf),
+          password_hash_(std::move(password_hash)), id_base_("gen" + std::to_string(opt.seed)) {}
+
+    // Renders the users of one chunk as ,"id":{...} entries.
+    std::string users_chunk(size_t chunk) const {
+        std::string out;
+        for (size_t u = chunk * USERS_PER_CHUNK; u < std::min(opt_.users, (chunk + 1) * USERS_PER_CHUNK); u++) {
+            std::string id = user_id(u);
+            out += ",\"" + id + "\":{\"user_id\":\"" + id + "\",\"username\":\"student" + std::to_string(u) +
+                   "\",\"password_hash\":\"" + password_hash_ + "\"}";
+        }
+        return out;
+    }
+
+    // Renders the sets of one chunk's users as ,"id":{...} entries, and
+    // counts what it made.
+    std::string sets_chunk(size_t chunk, size_t& sets, size_t& cards) const {
+        std::mt19937_64 rng(opt_.seed * 1000003 + chunk);
+        std::bernoulli_distribution long_back(opt_.long_back_rate);
+        std::bernoulli_distribution clone(opt_.clone_rate);
+        std::string out;
+        for (size_t u = chunk * USERS_PER_CHUNK; u < std::min(opt_.users, (chunk + 1) * USERS_PER_CHUNK); u++) {
+            std::string owner = user_id(u);
+            std::string cards_owner; // a set of this user's that clones can share cards with
+            size_t set_count = sets_.sample(rng);
+            for (size_t s = 0; s < set_count; s++) {
+                std::string id = id_base_ + "-s" + std::to_string(u) + "x" + std::to_string(s);
+                out += ",\"" + id + "\":{\"set_id\":\"" + id + "\",\"user_id\":\"" + owner + "\",\"title\":";
+                append_string(out, capitalized(words(rng, 1 + rng() % 5)));
+                out += ",\"description\":";
+                append_string(out, rng() % 3 ? words(rng, rng() % 25) : "");
+                out += ",\"tags\":[";
+                size_t tag_count = rng() % 4;
+                size_t first_tag = rng() % TAG_COUNT;
+                for (size_t t = 0; t < tag_count; t++) {
+                    if (t) out += ',';
+                    append_string(out, TAGS[(first_tag + t) % TAG_COUNT]);
+                }
+                out += ']';
+                sets++;
+                if (!cards_owner.empty() && clone(rng)) {
+                    out += ",\"cards_ref\":\"" + cards_owner + "\"}";
+                    continue;
+                }
+                out += ",\"cards\":[";
+                size_t card_count = cards_.sample(rng);
+                for (size_t c = 0; c < card_count; c++) {
+                    if (c) out += ',';
+                    out += "{\"card_id\":\"" + id_base_ + "-c" + std::to_string(u) + "x" + std::to_string(s) + "x" +
+                           std::to_string(c) + "\",\"front\":";
+                    append_string(out, words(rng, 1 + rng() % 4));
+                    out += ",\"back\":";
+                    append_string(out, long_back(rng) ? long_text(rng) : words(rng, back_words(rng)));
+                    out += '}';
+                }
+                out += "]}";
+                cards += card_count;
+                cards_owner = id;
+            }
+        }
+        return out;
+    }
+
+private:
+    std::string user_id(size_t u) const { return id_base_ + "-u" + std::to_string(u); }
+
+    static std::string words(std::mt19937_64& rng, size_t count) {
+        std::string out;
+        for (size_t i = 0; i < count; i++) {
+            if (i) out += ' ';
+            out += WORDS[rng() % WORD_COUNT];
+        }
+        return out;
+    }
+
+    static std::string capitalized(std::string s) {
+        if (!s.empty()) s[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(s[0])));
+        return s;
+    }
+
+    // Most backs are a short definition; about one in ten is a few sentences.
+    static size_t back_words(std::mt19937_64& rng) {
+        return rng() % 10 ? 2 + rng() % 15 : 20 + rng() % 80;
+    }
+
+    // A pasted page of notes: paragraphs of sentences up to long_back_bytes.
+    std::string long_text(std::mt19937_64& rng) const {
+        size_t target = opt_.long_back_bytes / 4 + rng() % (opt_.long_back_bytes - opt_.long_back_bytes / 4 + 1);
+        std::string out;
+        while (out.size() < target) {
+            out += capitalized(words(rng, 6 + rng() % 20));
+            out += rng() % 6 ? ". " : ".\n\n";
+        }
+        out.resize(target);
+        return out;
+    }
+
+    static void append_string(std::string& out, const std::string& s) {
+        out += '"';
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += static_cast<char>(c);
+            } else if (c == '\n') {
+                out += "\\n";
+            } else if (c < 0x20) {
+                char esc[8];
+                std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out += esc;
+            } else {
+                out += static_cast<char>(c);
+            }
+        }
+        out += '"';
+    }
+
+    const Options& opt_;
+    Zipf sets_;
+    Zipf cards_;
+    std::string password_hash_;
+    std::string id_base_;
+};
+
+// Renders chunks 0..chunks-1 on `threads` workers and writes them to out in
+// order, dropping the leading comma of the first entry. A worker that gets
+// too far ahead of the writer waits, which bounds memory.
+void write_chunks(std::ostream& out, size_t chunks, size_t threads, const std::function<std::string(size_t)>& render) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<size_t, std::string> ready;
+    size_t next_claim = 0;
+    size_t written = 0;
+    const size_t window = threads * CHUNKS_IN_FLIGHT_PER_THREAD;
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            while (true) {
+                size_t chunk;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&] { return next_claim >= chunks || next_claim < written + window; });
+                    if (next_claim >= chunks) return;
+                    chunk = next_claim++;
+                }
+                std::string text = render(chunk);
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.emplace(chunk, std::move(text));
+                cv.notify_all();
+            }
+        });
+    }
+
+    bool first = true;
+    for (; written < chunks;) {
+        std::string text;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return ready.count(written) > 0; });
+            text = std::move(ready.at(written));
+            ready.erase(written);
+        }
+        if (first && !text.empty()) {
+            out.write(text.data() + 1, text.size() - 1);
+            first = false;
+        } else {
+            out.write(text.data(), text.size());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        written++;
+        cv.notify_all();
+    }
+    for (auto& w : workers) w.join();
+}
+
+bool parse_args(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--users") opt.users = std::stoul(value);
+        else if (arg == "--max-sets") opt.max_sets = std::stoul(value);
+        else if (arg == "--max-cards") opt.max_cards = std::stoul(value);
+        else if (arg == "--zipf") opt.zipf = std::stod(value);
+        else if (arg == "--long-back-rate") opt.long_back_rate = std::stod(value);
+        else if (arg == "--long-back-bytes") opt.long_back_bytes = std::stoul(value);
+        else if (arg == "--clone-rate") opt.clone_rate = std::stod(value);
+        else if (arg == "--password") opt.password = value;
+        else if (arg == "--seed") opt.seed = std::stoull(value);
+        else if (arg == "--threads") opt.threads = std::stoul(value);
+        else if (arg == "--out") opt.out_path = value;
+        else return false;
+    }
+    return opt.users && opt.max_sets && opt.max_cards && opt.threads && opt.zipf >= 0 && opt.long_back_bytes &&
+           opt.long_back_rate >= 0 && opt.long_back_rate <= 1 && opt.clone_rate >= 0 && opt.clone_rate <= 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    try {
+        if (!parse_args(argc, argv, opt)) throw std::invalid_argument("usage");
+    } catch (const std::exception&) {
+        std::fprintf(stderr,
+                     "usage: %s [--users N] [--max-sets N] [--max-cards N] [--zipf S] [--long-back-rate P]\n"
+                     "          [--long-back-bytes N] [--clone-rate P] [--password PW] [--seed N] [--threads N]\n"
+                     "          [--out FILE]\n",
+                     argv[0]);
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    // One real hash shared by every user; hashing each one would take hours.
+    Generator generator(opt, hash_password(opt.password));
+    size_t chunks = (opt.users + USERS_PER_CHUNK - 1) / USERS_PER_CHUNK;
+
+    // Written next to the target and renamed over it at the end, as a
+    // partial file would not parse.
+    std::string tmp_path = opt.out_path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::fprintf(stderr, "cannot write %s\n", tmp_path.c_str());
+        return 1;
+    }
+    out << "{\"users\":{";
+    write_chunks(out, chunks, opt.threads, [&](size_t chunk) { return generator.users_chunk(chunk); });
+    out << "},\"sets\":{";
+    std::atomic<size_t> total_sets{0}, total_cards{0};
+    write_chunks(out, chunks, opt.threads, [&](size_t chunk) {
+        size_t sets = 0, cards = 0;
+        std::string text = generator.sets_chunk(chunk, sets, cards);
+        total_sets += sets;
+        total_cards += cards;
+        return text;
+    });
+    out << "}}\n";
+    out.close();
+    if (!out || std::rename(tmp_path.c_str(), opt.out_path.c_str()) != 0) {
+        std::fprintf(stderr, "failed writing %s\n", opt.out_path.c_str());
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mb = std::filesystem::file_size(opt.out_path) / 1e6;
+    std::fprintf(stderr, "wrote %s: %zu users, %zu sets, %zu cards, %.1f MB in %.1fs (%.0f MB/s)\n",
+                 opt.out_path.c_str(), opt.users, total_sets.load(), total_cards.load(), mb, seconds, mb / seconds);
+    return 0;
+}
@@ -0,0 +1,433 @@
+// HTTP load generator for a running Flipit server. It registers a population
+// of students, gives each some sets of cards, and then replays a weighted mix
+// of the traffic students produce: dashboard loads, set fetches, quizzes,
+// quiz answers and card edits. Latency is reported per route as JSON.
+//
+// Build and run from backend/:
+//
+//   g++ -std=c++17 -O2 -Iinclude -Isrc bench/load_gen.cpp -pthread -o load_gen
+//   ./load_gen --rate 500 --duration 30                 # open loop, 500 req/s
+//   ./load_gen --mode closed --connections 64 --think-ms 200
+//   ./load_gen --mix dashboard=30,set=30,quiz=20,answer=10,edit=10 --out load.json
+//
+// Open loop (the default) sends on a fixed schedule whatever the server does,
+// and measures each request from the time it was scheduled to go out, so a
+// stall is charged to every request it delayed rather than only to the one
+// that hit it (coordinated omission). Closed loop has each connection wait
+// for its response and then think before the next request; there the stall
+// correction back-fills the requests a connection would have sent every
+// --expected-ms (default: the think time) had it not been blocked.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "httplib.h"
+#include "json.hpp"
+#include "metrics.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum Op { DASHBOARD, SET_FETCH, QUIZ, ANSWER, CARD_EDIT, OPS };
+
+const char* OP_NAMES[OPS] = {"dashboard", "set", "quiz", "answer", "edit"};
+const char* OP_ROUTES[OPS] = {"GET /api/sets", "GET /api/sets/:id", "POST /api/sets/:id/quiz", "POST /api/stats",
+                              "PUT /api/sets/:id/cards/:id"};
+
+const int QUIZ_SIZE = 10;
+const int SETUP_RETRIES = 50;
+
+struct Options {
+    std::string host = "localhost";
+    int port = 8080;
+    size_t users = 50;
+    size_t sets_per_user = 3;
+    size_t cards_per_set = 40;
+    size_t connections = 16;
+    int duration_s = 30;
+    bool open_loop = true;
+    double rate = 200;        // requests per second across all connections (open loop)
+    int think_ms = 0;         // pause between a response and the next request (closed loop)
+    int expected_ms = -1;     // closed-loop correction interval; -1 means think_ms
+    double mix[OPS] = {30, 30, 15, 15, 10};
+    uint64_t seed = 42;
+    std::string out_path;
+};
+
+struct StudySet {
+    std::string set_id;
+    std::vector<std::string> card_ids;
+};
+
+struct Student {
+    std::string token;
+    std::vector<StudySet> sets;
+};
+
+struct RouteStats {
+    metrics::Histogram corrected; // from the scheduled send time
+    metrics::Histogram service;   // from the actual send time
+    uint64_t corrected_max_us = 0;
+    uint64_t service_max_us = 0;
+    std::map<int, uint64_t> statuses; // 0 = connection failure
+};
+
+struct WorkerStats {
+    RouteStats routes[OPS];
+    uint64_t missed = 0; // scheduled sends that never went out before the deadline
+};
+
+const char* WORDS[] = {"cell", "membrane", "protein", "energy", "reaction", "theory", "river", "empire", "verb",
+                       "equation", "function", "gradient", "treaty", "climate", "enzyme", "molecule", "atom",
+                       "language", "history", "pressure", "current", "vector", "matrix", "nucleus", "orbit"};
+
+std::string words(std::mt19937_64& rng, size_t count) {
+    std::string out;
+    for (size_t i = 0; i < count; i++) {
+        if (i) out += ' ';
+        out += WORDS[rng() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+    }
+    return out;
+}
+
+httplib::Headers auth(const Student& s) { return {{"Authorization", "Bearer " + s.token}}; }
+
+uint64_t micros(Clock::duration d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); }
+
+// Sends a setup request, retrying while the server sheds it (the KDF pool
+// answers 503 when registrations arrive faster than it can hash).
+httplib::Result setup_request(const std::function<httplib::Result()>& send) {
+    for (int attempt = 0;; attempt++) {
+        auto res = send();
+        if ((res && res->status != 503 && res->status != 429) || attempt == SETUP_RETRIES) return res;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100 * std::min(attempt + 1, 10)));
+    }
+}
+
+bool expect(const httplib::Result& res, int status, const char* what) {
+    if (res && res->status == status) return true;
+    std::fprintf(stderr, "setup failed: %s returned %s\n", what,
+                 res ? std::to_string(res->status).c_str() : httplib::to_string(res.error()).c_str());
+    return false;
+}
+
+// Registers and logs in one student and creates their library.
+bool create_student(httplib::Client& cli, const Options& opt, const std::string& username, std::mt19937_64& rng,
+                    Student& student) {
+    json credentials = {{"username", username}, {"password", "load-test-password"}};
+    auto res = setup_request([&] { return cli.Post("/api/register", credentials.dump(), "application/json"); });
+    if (!expect(res, 201, "register")) return false;
+    res = setup_request([&] { return cli.Post("/api/login", credentials.dump(), "application/json"); });
+    if (!expect(res, 200, "login")) return false;
+    student.token = json::parse(res->body).at("token");
+
+    static const char* TAGS[] = {"biology", "chemistry", "history", "language", "math", "exam"};
+    for (size_t s = 0; s < opt.sets_per_user; s++) {
+        json set = {{"title", words(rng, 2 + rng() % 3)},
+                    {"description", words(rng, rng() % 12)},
+                    {"tags", {TAGS[rng() % 6]}}};
+        res = setup_request([&] { return cli.Post("/api/sets", auth(student), set.dump(), "application/json"); });
+        if (!expect(res, 201, "create set")) return false;
+        StudySet study;
+        study.set_id = json::parse(res->body).at("set_id");
+        for (size_t c = 0; c < opt.cards_per_set; c++) {
+            json card = {{"front", words(rng, 1 + rng() % 3)}, {"back", words(rng, 3 + rng() % 20)}};
+            std::string path = "/api/sets/" + study.set_id + "/cards";
+            res = setup_request([&] { return cli.Post(path, auth(student), card.dump(), "application/json"); });
+            if (!expect(res, 201, "create card")) return false;
+            study.card_ids.push_back(json::parse(res->body).at("card_id"));
+        }
+        student.sets.push_back(std::move(study));
+    }
+    return true;
+}
+
+std::unique_ptr<httplib::Client> connect(const Options& opt) {
+    auto cli = std::make_unique<httplib::Client>(opt.host, opt.port);
+    cli->set_keep_alive(true);
+    cli->set_connection_timeout(5);
+    cli->set_read_timeout(60);
+    return cli;
+}
+
+// Sends one request of the given kind for a random set of the student's and
+// returns its status, or 0 when no response arrived.
+int send(httplib::Client& cli, Op op, const Student& student, std::mt19937_64& rng) {
+    const StudySet& set = student.sets[rng() % student.sets.size()];
+    const std::string set_path = "/api/sets/" + set.set_id;
+    httplib::Result res;
+    switch (op) {
+    case DASHBOARD:
+        res = cli.Get("/api/sets", auth(student));
+        break;
+    case SET_FETCH:
+        res = cli.Get(set_path, auth(student));
+        break;
+    case QUIZ:
+        res = cli.Post(set_path + "/quiz", auth(student), "{\"count\":" + std::to_string(QUIZ_SIZE) + "}",
+                       "application/json");
+        break;
+    case ANSWER: {
+        json results = json::array();
+        for (int i = 0; i < QUIZ_SIZE; i++) {
+            int grade = static_cast<int>(rng() % 6);
+            results.push_back({{"card_id", set.card_ids[rng() % set.card_ids.size()]},
+                               {"correct", grade >= 3},
+                               {"grade", grade},
+                               {"latency_ms", 800 + rng() % 8000}});
+        }
+        json body = {{"set_id", set.set_id}, {"results", results}};
+        res = cli.Post("/api/stats", auth(student), body.dump(), "application/json");
+        break;
+    }
+    case CARD_EDIT: {
+        json card = {{"front", words(rng, 1 + rng() % 3)}, {"back", words(rng, 3 + rng() % 20)}};
+        res = cli.Put(set_path + "/cards/" + set.card_ids[rng() % set.card_ids.size()], auth(student), card.dump(),
+                      "application/json");
+        break;
+    }
+    default:
+        break;
+    }
+    return res ? res->status : 0;
+}
+
+void record(metrics::Histogram& histogram, uint64_t& max_us, uint64_t us) {
+    histogram.record(us);
+    max_us = std::max(max_us, us);
+}
+
+// Records a closed-loop latency along with the samples a connection that is
+// expected to send every expected_us would have taken while it was blocked.
+void record_corrected(RouteStats& stats, uint64_t us, uint64_t expected_us) {
+    record(stats.corrected, stats.corrected_max_us, us);
+    if (!expected_us) return;
+    for (uint64_t missing = us > expected_us ? us - expected_us : 0; missing >= expected_us; missing -= expected_us) {
+        stats.corrected.record(missing);
+    }
+}
+
+void run_worker(const Options& opt, size_t index, const std::vector<Student>& students, Clock::time_point start,
+                Clock::time_point deadline, WorkerStats& stats) {
+    std::mt19937_64 rng(opt.seed * 7919 + index);
+    std::discrete_distribution<int> pick(opt.mix, opt.mix + OPS);
+    auto cli = connect(opt);
+
+    // Each connection carries an equal share of the rate, staggered so the
+    // connections do not fire in lockstep.
+    auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(opt.connections / opt.rate));
+    Clock::time_point scheduled = start + interval * index / opt.connections;
+    uint64_t expected_us = opt.expected_ms >= 0 ? opt.expected_ms * 1000ull : opt.think_ms * 1000ull;
+
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (opt.open_loop) {
+            if (scheduled >= deadline) break;
+            if (now >= deadline) {
+                stats.missed += (deadline - scheduled + interval - Clock::duration(1)) / interval;
+                break;
+            }
+            if (now < scheduled) std::this_thread::sleep_until(scheduled);
+        } else if (now >= deadline) {
+            break;
+        }
+
+        Op op = static_cast<Op>(pick(rng));
+        Clock::time_point sent = Clock::now();
+        int status = send(*cli, op, students[rng() % students.size()], rng);
+        Clock::time_point done = Clock::now();
+
+        RouteStats& route = stats.routes[op];
+        route.statuses[status]++;
+        record(route.service, route.service_max_us, micros(done - sent));
+        if (opt.open_loop) {
+            record(route.corrected, route.corrected_max_us, micros(done - scheduled));
+            scheduled += interval;
+        } else {
+            record_corrected(route, micros(done - sent), expected_us);
+            if (opt.think_ms) std::this_thread::sleep_for(std::chrono::milliseconds(opt.think_ms));
+        }
+    }
+}
+
+// Quantiles are bucket upper edges (within 25%), capped at the exact max.
+json latency_json(const metrics::Histogram::Snapshot& snap, uint64_t max_us) {
+    auto q = [&](double quantile) { return std::min(snap.quantile_us(quantile), max_us); };
+    return {{"mean_us", snap.count ? snap.sum_us / snap.count : 0},
+            {"p50_us", q(0.5)},
+            {"p90_us", q(0.9)},
+            {"p99_us", q(0.99)},
+            {"p999_us", q(0.999)},
+            {"max_us", max_us}};
+}
+
+bool parse_mix(const std::string& list, double mix[OPS]) {
+    std::fill(mix, mix + OPS, 0.0);
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        auto name = std::find_if(OP_NAMES, OP_NAMES + OPS, [&](const char* n) { return item.compare(0, eq, n) == 0; });
+        if (name == OP_NAMES + OPS) return false;
+        mix[name - OP_NAMES] = std::stod(item.substr(eq + 1));
+    }
+    return std::any_of(mix, mix + OPS, [](double w) { return w > 0; });
+}
+
+bool parse_args(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--host") opt.host = value;
+        else if (arg == "--port") opt.port = std::stoi(value);
+        else if (arg == "--users") opt.users = std::stoul(value);
+        else if (arg == "--sets") opt.sets_per_user = std::stoul(value);
+        else if (arg == "--cards") opt.cards_per_set = std::stoul(value);
+        else if (arg == "--connections") opt.connections = std::stoul(value);
+        else if (arg == "--duration") opt.duration_s = std::stoi(value);
+        else if (arg == "--mode" && (value == "open" || value == "closed")) opt.open_loop = value == "open";
+        else if (arg == "--rate") opt.rate = std::stod(value);
+        else if (arg == "--think-ms") opt.think_ms = std::stoi(value);
+        else if (arg == "--expected-ms") opt.expected_ms = std::stoi(value);
+        else if (arg == "--mix") { if (!parse_mix(value, opt.mix)) return false; }
+        else if (arg == "--seed") opt.seed = std::stoull(value);
+        else if (arg == "--out") opt.out_path = value;
+        else return false;
+    }
+    return opt.users && opt.sets_per_user && opt.cards_per_set && opt.connections && opt.duration_s > 0 && opt.rate > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    try {
+        if (!parse_args(argc, argv, opt)) throw std::invalid_argument("usage");
+    } catch (const std::exception&) {
+        std::fprintf(stderr,
+                     "usage: %s [--host H] [--port P] [--users N] [--sets N] [--cards N] [--connections N]\n"
+                     "          [--duration S] [--mode open|closed] [--rate R] [--think-ms MS] [--expected-ms MS]\n"
+                     "          [--mix dashboard=W,set=W,quiz=W,answer=W,edit=W] [--seed N] [--out FILE]\n",
+                     argv[0]);
+        return 2;
+    }
+
+    // Set up the students in parallel; usernames are unique per run so the
+    // tool can be pointed at the same server repeatedly.
+    std::vector<Student> students(opt.users);
+    std::atomic<bool> setup_ok{true};
+    std::string prefix = "load" + std::to_string(getpid()) + "x" + std::to_string(std::time(nullptr)) + "u";
+    auto setup_start = Clock::now();
+    {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < std::min(opt.connections, opt.users); t++) {
+            threads.emplace_back([&, t] {
+                std::mt19937_64 rng(opt.seed + t);
+                auto cli = connect(opt);
+                for (size_t u = t; u < opt.users && setup_ok; u += opt.connections) {
+                    if (!create_student(*cli, opt, prefix + std::to_string(u), rng, students[u])) setup_ok = false;
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+    }
+    if (!setup_ok) return 1;
+    std::fprintf(stderr, "set up %zu students with %zu cards each in %.1fs\n", opt.users,
+                 opt.sets_per_user * opt.cards_per_set, micros(Clock::now() - setup_start) / 1e6);
+
+    std::vector<std::unique_ptr<WorkerStats>> stats;
+    for (size_t t = 0; t < opt.connections; t++) stats.push_back(std::make_unique<WorkerStats>());
+    auto start = Clock::now() + std::chrono::milliseconds(100);
+    auto deadline = start + std::chrono::seconds(opt.duration_s);
+    {
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < opt.connections; t++) {
+            threads.emplace_back(run_worker, std::cref(opt), t, std::cref(students), start, deadline, std::ref(*stats[t]));
+        }
+        for (auto& t : threads) t.join();
+    }
+    double elapsed_s = micros(Clock::now() - start) / 1e6;
+
+    json routes = json::object();
+    uint64_t total = 0, errors = 0, missed = 0;
+    for (const auto& s : stats) missed += s->missed;
+    std::fprintf(stderr, "%-28s %9s %7s %10s %10s %10s %10s\n", "route", "requests", "errors", "p50 ms", "p99 ms",
+                 "p99.9 ms", "max ms");
+    for (int op = 0; op < OPS; op++) {
+        metrics::Histogram::Snapshot corrected, service;
+        uint64_t corrected_max = 0, service_max = 0;
+        std::map<int, uint64_t> statuses;
+        for (const auto& s : stats) {
+            const RouteStats& r = s->routes[op];
+            r.corrected.snapshot_into(corrected);
+            r.service.snapshot_into(service);
+            corrected_max = std::max(corrected_max, r.corrected_max_us);
+            service_max = std::max(service_max, r.service_max_us);
+            for (const auto& st : r.statuses) statuses[st.first] += st.second;
+        }
+        if (!service.count) continue;
+        uint64_t route_errors = 0;
+        json status_json = json::object();
+        for (const auto& st : statuses) {
+            status_json[std::to_string(st.first)] = st.second;
+            if (st.first < 200 || st.first >= 300) route_errors += st.second;
+        }
+        total += service.count;
+        errors += route_errors;
+        routes[OP_ROUTES[op]] = {{"requests", service.count},
+                                 {"errors", route_errors},
+                                 {"statuses", status_json},
+                                 {"latency", latency_json(corrected, corrected_max)},
+                                 {"service_time", latency_json(service, service_max)}};
+        std::fprintf(stderr, "%-28s %9llu %7llu %10.2f %10.2f %10.2f %10.2f\n", OP_ROUTES[op],
+                     static_cast<unsigned long long>(service.count), static_cast<unsigned long long>(route_errors),
+                     std::min(corrected.quantile_us(0.5), corrected_max) / 1e3,
+                     std::min(corrected.quantile_us(0.99), corrected_max) / 1e3,
+                     std::min(corrected.quantile_us(0.999), corrected_max) / 1e3, corrected_max / 1e3);
+    }
+    std::fprintf(stderr, "%llu requests in %.1fs (%.0f/s), %llu errors, %llu scheduled requests not sent\n",
+                 static_cast<unsigned long long>(total), elapsed_s, total / elapsed_s,
+                 static_cast<unsigned long long>(errors), static_cast<unsigned long long>(missed));
+
+    json report = {{"mode", opt.open_loop ? "open" : "closed"},
+                   {"connections", opt.connections},
+                   {"duration_s", elapsed_s},
+                   {"users", opt.users},
+                   {"cards_per_user", opt.sets_per_user * opt.cards_per_set},
+                   {"requests", total},
+                   {"errors", errors},
+                   {"throughput_rps", total / elapsed_s},
+                   {"routes", routes}};
+    if (opt.open_loop) {
+        report["target_rps"] = opt.rate;
+        report["missed"] = missed;
+    } else {
+        report["think_ms"] = opt.think_ms;
+        report["expected_ms"] = opt.expected_ms >= 0 ? opt.expected_ms : opt.think_ms;
+    }
+    if (opt.out_path.empty()) {
+        std::cout << report.dump(2) << "\n";
+    } else {
+        std::ofstream(opt.out_path) << report.dump(2) << "\n";
+    }
+    return 0;
+}
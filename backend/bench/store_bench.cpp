@@ -0,0 +1,239 @@
+// Benchmarks for the in-memory store and its serialization paths, run
+// against the server's own code at several library sizes. Results are
+// written as one JSON document so runs can be diffed between releases.
+//
+// Build and run from backend/:
+//
+//   g++ -std=c++17 -O2 -Iinclude -Isrc bench/store_bench.cpp -pthread -o store_bench
+//   ./store_bench                        # 1K, 100K and 1M cards
+//   ./store_bench --cards 1000,100000 --out bench.json
+//
+// The benchmarks run in a scratch directory, so data.json and the other
+// state files in the working directory are never touched.
+#define FLIPIT_NO_MAIN
+#include "server.cpp"
+
+#include <unistd.h>
+
+namespace {
+
+const size_t CARDS_PER_SET = 50;
+const size_t SETS_PER_USER = 10;
+const auto MIN_BENCH_TIME = std::chrono::milliseconds(300);
+const size_t MAX_ITERATIONS = 1000000;
+
+struct BenchResult {
+    std::string name;
+    size_t cards;
+    size_t iterations;
+    double ns_per_op;
+};
+
+std::vector<BenchResult> g_results;
+
+// Calls fn (which performs ops_per_call operations) until MIN_BENCH_TIME has
+// been spent inside it, and records the mean cost of one operation. setup
+// runs before every call and is not timed.
+template <typename Fn, typename Setup>
+void measure(const std::string& name, size_t cards, size_t ops_per_call, Fn fn, Setup setup) {
+    setup();
+    fn(); // warm up caches and lazily built state
+    size_t iterations = 0;
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    while (elapsed < MIN_BENCH_TIME && iterations < MAX_ITERATIONS) {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        elapsed += std::chrono::steady_clock::now() - start;
+        iterations++;
+    }
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / (double(iterations) * ops_per_call);
+    g_results.push_back({name, cards, iterations * ops_per_call, ns});
+    std::fprintf(stderr, "%-28s %9zu cards %14.1f ns/op\n", name.c_str(), cards, ns);
+}
+
+template <typename Fn>
+void measure(const std::string& name, size_t cards, size_t ops_per_call, Fn fn) {
+    measure(name, cards, ops_per_call, fn, [] {});
+}
+
+// Defeats dead-code elimination of benchmarked results.
+volatile size_t g_sink;
+
+// Empties the store and every index built from it, through the hooks the
+// handlers use when a set is deleted, so each scale and each loadData run
+// starts from nothing.
+void clear_store() {
+    for (const auto& pair : g_sets) {
+        g_tags.set_removed(pair.second);
+        charge_set(pair.second, -1);
+        g_stats.set_removed(pair.second.user_id, pair.first);
+        g_quiz_samplers.invalidate(pair.first);
+        g_memory.forget_set(pair.first);
+    }
+    for (const auto& pair : g_users) {
+        g_suggestions.reset(pair.first);
+        g_distractors.reset(pair.first);
+        g_duplicates.reset(pair.first);
+        g_related.reset(pair.first);
+        g_memory.charge(memory::USERS, pair.first, "", -user_bytes(pair.second));
+    }
+    g_users.clear();
+    g_sets.clear();
+}
+
+// Fills the store with `cards` cards: SETS_PER_USER sets of CARDS_PER_SET
+// cards per user, with a few tags per set. The generated store is saved and
+// loaded back, so every index is in the state loadData() leaves it in after
+// a restart; the per-user indexes build on first use as they do there.
+void populate(size_t cards) {
+    clear_store();
+    std::mt19937_64 rng(42);
+    static const char* TAGS[] = {"biology", "chemistry", "history", "language", "math", "exam", "review", "hard"};
+    size_t sets = std::max<size_t>(1, cards / CARDS_PER_SET);
+    size_t per_set = std::max<size_t>(1, cards / sets);
+    for (size_t s = 0; s < sets; s++) {
+        size_t u = s / SETS_PER_USER;
+        std::string user_id = "1700000000-" + std::to_string(u);
+        if (!g_users.count(user_id)) {
+            g_users[user_id] = User{user_id, "student" + std::to_string(u), "scrypt$15$8$1$00$00"};
+        }
+        FlashcardSet set;
+        set.set_id = "1700000001-" + std::to_string(s);
+        set.user_id = user_id;
+        set.title = "Set " + std::to_string(s) + " vocabulary";
+        set.description = "Generated for benchmarking";
+        set.tags = {TAGS[rng() % 8], TAGS[rng() % 8]};
+        std::sort(set.tags.begin(), set.tags.end());
+        set.tags.erase(std::unique(set.tags.begin(), set.tags.end()), set.tags.end());
+        std::vector<Flashcard> list;
+        for (size_t c = 0; c < per_set; c++) {
+            list.push_back({"1700000002-" + std::to_string(s * per_set + c), "term " + std::to_string(c),
+                            "definition of term " + std::to_string(c) + " in set " + std::to_string(s)});
+        }
+        set.cards = CardList(std::move(list));
+        g_sets[set.set_id] = set;
+    }
+    saveData();
+    // Nothing was indexed yet, so the maps are emptied directly.
+    g_users.clear();
+    g_sets.clear();
+    loadData();
+}
+
+const httplib::Server::Handler& route_handler(const std::string& method, const std::string& path) {
+    for (const auto& route : g_batch_routes) {
+        std::smatch m;
+        if (route.method == method && std::regex_match(path, m, route.pattern)) return route.handler;
+    }
+    std::fprintf(stderr, "no route for %s %s\n", method.c_str(), path.c_str());
+    std::exit(1);
+}
+
+void run_scale(size_t cards) {
+    populate(cards);
+    measure("saveData", cards, 1, [] { saveData(); });
+    measure("loadData", cards, 1, [] { loadData(); }, [] { clear_store(); });
+
+    // Taken after loadData, which replaces every entry in the store.
+    std::vector<const FlashcardSet*> sets;
+    for (const auto& pair : g_sets) sets.push_back(&pair.second);
+    std::vector<const User*> users;
+    for (const auto& pair : g_users) users.push_back(&pair.second);
+
+    size_t next = 0;
+    measure("set_to_json/cards", cards, 1, [&] { g_sink = set_to_json(*sets[next++ % sets.size()]).size(); });
+    measure("set_to_json/header", cards, 1, [&] { g_sink = set_to_json(*sets[next++ % sets.size()], false).size(); });
+
+    // A miss, as on every registration, is the worst case for the scan.
+    measure("find_user_by_username/hit", cards, 1, [&] {
+        g_sink = find_user_by_username(users[next++ % users.size()]->username) != nullptr;
+    });
+    measure("find_user_by_username/miss", cards, 1, [&] { g_sink = find_user_by_username("nobody") != nullptr; });
+
+    // The real GET /api/sets handler for the first user, unfiltered and with
+    // a tag filter.
+    httplib::Request list_req;
+    list_req.headers.emplace("Authorization", "Bearer " + g_sessions.create(users[0]->user_id));
+    const auto& list_sets = route_handler("GET", "/api/sets");
+    measure("GET /api/sets", cards, 1, [&] {
+        httplib::Response res;
+        list_sets(list_req, res);
+        g_sink = res.body.size();
+    });
+    httplib::Request filter_req = list_req;
+    filter_req.params.emplace("any", "biology,math");
+    filter_req.params.emplace("not", "hard");
+    measure("GET /api/sets?any=&not=", cards, 1, [&] {
+        httplib::Response res;
+        list_sets(filter_req, res);
+        g_sink = res.body.size();
+    });
+
+    // Finding a card by id and erasing it, as the card routes do; the card
+    // goes back afterwards so every iteration sees the same set.
+    FlashcardSet& set = g_sets.begin()->second;
+    measure("card find+erase", cards, 1, [&] {
+        const std::string card_id = set.cards[next++ % set.cards.size()].card_id;
+        auto found = std::find_if(set.cards.begin(), set.cards.end(), [&card_id](const Flashcard& c) { return c.card_id == card_id; });
+        size_t index = found - set.cards.begin();
+        Flashcard card = *found;
+        set.cards.erase(index);
+        set.cards.push_back(std::move(card));
+    });
+
+    measure("generate_id", cards, 1000, [] {
+        for (int i = 0; i < 1000; i++) g_sink = generate_id().size();
+    });
+}
+
+std::vector<size_t> parse_sizes(const std::string& list) {
+    std::vector<size_t> out;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) out.push_back(std::stoul(item));
+    return out;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<size_t> scales = {1000, 100000, 1000000};
+    std::string out_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cards" && i + 1 < argc) {
+            scales = parse_sizes(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--cards N,N,...] [--out FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!out_path.empty() && out_path[0] != '/') out_path = std::filesystem::current_path() / out_path;
+
+    std::filesystem::path scratch = std::filesystem::temp_directory_path() / ("flipit-bench-" + std::to_string(getpid()));
+    std::filesystem::create_directories(scratch);
+    std::filesystem::current_path(scratch);
+
+    httplib::Server svr;
+    setup_routes(svr);
+    for (size_t cards : scales) run_scale(cards);
+
+    json results = json::array();
+    for (const auto& r : g_results) {
+        results.push_back({{"name", r.name}, {"cards", r.cards}, {"iterations", r.iterations},
+                           {"ns_per_op", r.ns_per_op}, {"ops_per_sec", r.ns_per_op > 0 ? 1e9 / r.ns_per_op : 0.0}});
+    }
+    json report = {{"suite", "store"}, {"timestamp", unix_now()}, {"compiler", __VERSION__}, {"results", results}};
+
+    std::filesystem::current_path(std::filesystem::temp_directory_path());
+    std::filesystem::remove_all(scratch);
+    if (out_path.empty()) {
+        std::cout << report.dump(2) << "\n";
+    } else {
+        std::ofstream(out_path) << report.dump(2) << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "httplib.h"
+#include "metrics.h"
+
+// Admission control in front of httplib's workers. httplib hands its task
+// queue one task per accepted connection; this queue bounds how many may
+// wait for a worker and sheds them CoDel-style once queueing delay has stood
+// above a target for a whole interval, instead of letting every request in
+// the backlog wait seconds.
+//
+// A shed connection is not closed unanswered: it is passed to a small pool
+// of rejecter threads that run it with shedding() set, so the pre-routing
+// handler answers its first request with a 503 and Retry-After, closes the
+// connection and the client backs off. A rejecter is held only until that
+// one request has been read, so a slow client ties up one rejecter, not
+// all of them. Once shed connections have waited reject_deadline for a
+// rejecter, the rejecters are stuck on slow clients and new connections are
+// closed outright instead of queueing behind them.
+//
+// Admission is decided when a connection first gets a worker; requests that
+// follow on an admitted keep-alive connection are not queued again.
+namespace admission {
+
+struct Options {
+    size_t threads = CPPHTTPLIB_THREAD_POOL_COUNT;
+    size_t max_queue = 256;                     // connections waiting for a worker
+    size_t reject_threads = 4;                  // threads answering shed connections
+    std::chrono::milliseconds reject_deadline{1000}; // longest a shed connection waits for one
+    std::chrono::milliseconds target{50};      // acceptable standing queue delay
+    std::chrono::milliseconds interval{500};   // how long delay may exceed target before shedding
+    metrics::HistogramFamily* queue_delay = nullptr; // optional, records each admitted task's wait
+};
+
+// Running totals, owned by the caller so they outlive each queue httplib
+// creates and destroys.
+struct Counters {
+    std::atomic<uint64_t> admitted{0};
+    std::atomic<uint64_t> shed_queue_full{0};
+    std::atomic<uint64_t> shed_queue_delay{0};
+    std::atomic<uint64_t> dropped{0}; // closed without a response
+    std::atomic<size_t> queued{0};
+};
+
+namespace detail {
+inline bool& shed_flag() {
+    thread_local bool shed = false;
+    return shed;
+}
+} // namespace detail
+
+// True while the calling thread is answering a shed connection.
+inline bool shedding() { return detail::shed_flag(); }
+
+class AdmissionQueue : public httplib::TaskQueue {
+public:
+    AdmissionQueue(Options options, Counters& counters) : options_(options), counters_(counters) {
+        for (size_t i = 0; i < options_.threads; i++) workers_.emplace_back([this] { run_worker(); });
+        for (size_t i = 0; i < std::max<size_t>(1, options_.reject_threads); i++) {
+            rejecters_.emplace_back([this] { run_rejecter(); });
+        }
+    }
+
+    AdmissionQueue(const AdmissionQueue&) = delete;
+    AdmissionQueue& operator=(const AdmissionQueue&) = delete;
+
+    ~AdmissionQueue() override { shutdown(); }
+
+    bool enqueue(std::function<void()> fn) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (shutdown_) return false;
+            if (jobs_.size() >= options_.max_queue) {
+                if (!reject(fn)) {
+                    counters_.dropped++;
+                    return false;
+                }
+                counters_.shed_queue_full++;
+                return true;
+            }
+            jobs_.push_back({std::move(fn), Clock::now()});
+            counters_.queued = jobs_.size();
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    void shutdown() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (shutdown_) return;
+            shutdown_ = true;
+        }
+        cond_.notify_all();
+        reject_cond_.notify_all();
+        for (auto& t : workers_) t.join();
+        for (auto& t : rejecters_) t.join();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        std::function<void()> fn;
+        Clock::time_point enqueued;
+    };
+
+    void run_worker() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this] { return shutdown_ || !jobs_.empty(); });
+                if (!next_admitted(job)) {
+                    if (shutdown_ && jobs_.empty()) return;
+                    continue;
+                }
+            }
+            if (options_.queue_delay) {
+                auto waited = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - job.enqueued);
+                options_.queue_delay->record("", waited.count());
+            }
+            job.fn();
+        }
+    }
+
+    // Pops jobs until one is admitted, handing the ones CoDel sheds to the
+    // rejecters. Called with mutex_ held; false if the queue ran dry.
+    bool next_admitted(Job& job) {
+        while (!jobs_.empty()) {
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+            counters_.queued = jobs_.size();
+            Clock::time_point now = Clock::now();
+            // Nothing is shed at shutdown; the backlog is served as is. A
+            // job the rejecters cannot take is served too, since only
+            // running it closes its socket.
+            if (shutdown_ || !should_shed(now, now - job.enqueued) || !reject(job.fn)) {
+                counters_.admitted++;
+                return true;
+            }
+            counters_.shed_queue_delay++;
+        }
+        return false;
+    }
+
+    // CoDel (Nichols & Jacobson): once the delay of dequeued jobs has stayed
+    // above target for an interval, shed one job and schedule the next shed
+    // interval/sqrt(n) later, so the shed rate rises until the delay falls
+    // back under target. Called with mutex_ held.
+    bool should_shed(Clock::time_point now, Clock::duration sojourn) {
+        bool above = false;
+        if (sojourn < options_.target) {
+            first_above_ = Clock::time_point();
+        } else if (first_above_ == Clock::time_point()) {
+            first_above_ = now + options_.interval;
+        } else {
+            above = now >= first_above_;
+        }
+
+        if (dropping_) {
+            if (!above) {
+                dropping_ = false;
+                return false;
+            }
+            if (now < drop_next_) return false;
+            count_++;
+            drop_next_ = control_law(drop_next_);
+            return true;
+        }
+        if (!above) return false;
+        dropping_ = true;
+        // Resume near the previous shed rate if the last episode was recent.
+        count_ = count_ > 2 && now - drop_next_ < 16 * options_.interval ? count_ - 2 : 1;
+        drop_next_ = control_law(now);
+        return true;
+    }
+
+    Clock::time_point control_law(Clock::time_point from) const {
+        return from + std::chrono::duration_cast<Clock::duration>(options_.interval / std::sqrt(static_cast<double>(count_)));
+    }
+
+    // Queues fn for a rejecter, taking it only on success. Called with
+    // mutex_ held.
+    bool reject(std::function<void()>& fn) {
+        Clock::time_point now = Clock::now();
+        if (rejects_.size() >= options_.max_queue ||
+            (!rejects_.empty() && now - rejects_.front().enqueued > options_.reject_deadline)) {
+            return false;
+        }
+        rejects_.push_back({std::move(fn), now});
+        reject_cond_.notify_one();
+        return true;
+    }
+
+    void run_rejecter() {
+        detail::shed_flag() = true;
+        for (;;) {
+            std::function<void()> fn;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                reject_cond_.wait(lock, [this] { return shutdown_ || !rejects_.empty(); });
+                if (rejects_.empty()) return;
+                fn = std::move(rejects_.front().fn);
+                rejects_.pop_front();
+            }
+            fn();
+        }
+    }
+
+    const Options options_;
+    Counters& counters_;
+
+    std::mutex mutex_; // guards everything below
+    std::condition_variable cond_;
+    std::condition_variable reject_cond_;
+    std::deque<Job> jobs_;
+    std::deque<Job> rejects_;
+    bool shutdown_ = false;
+
+    // CoDel state.
+    Clock::time_point first_above_;
+    Clock::time_point drop_next_;
+    bool dropping_ = false;
+    uint32_t count_ = 0;
+
+    std::vector<std::thread> workers_;
+    std::vector<std::thread> rejecters_;
+};
+
+} // namespace admission
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Vose's alias method: O(n) to build from a list of non-negative weights,
+// then O(1) per weighted draw.
+class AliasTable {
+public:
+    AliasTable() = default;
+
+    explicit AliasTable(const std::vector<double>& weights) {
+        size_t n = weights.size();
+        prob_.assign(n, 0.0);
+        alias_.assign(n, 0);
+        if (n == 0) {
+            return;
+        }
+
+        double total = 0;
+        for (double w : weights) total += w;
+        std::vector<double> scaled(n);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; i++) {
+            scaled[i] = total > 0 ? weights[i] * n / total : 1.0;
+            (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+        }
+
+        while (!small.empty() && !large.empty()) {
+            uint32_t s = small.back();
+            small.pop_back();
+            uint32_t l = large.back();
+            prob_[s] = scaled[s];
+            alias_[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Whatever is left is 1.0 up to rounding error.
+        for (uint32_t i : large) prob_[i] = 1.0;
+        for (uint32_t i : small) prob_[i] = 1.0;
+    }
+
+    size_t size() const { return prob_.size(); }
+
+    template <typename Rng>
+    size_t sample(Rng& rng) const {
+        std::uniform_int_distribution<size_t> column(0, prob_.size() - 1);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        size_t i = column(rng);
+        return coin(rng) < prob_[i] ? i : alias_[i];
+    }
+
+private:
+    std::vector<double> prob_;
+    std::vector<uint32_t> alias_;
+};
@@ -0,0 +1,488 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "json.hpp"
+#include "logger.h"
+
+// Append-only log of quiz answers, kept out of data.json.
+//
+// Events are buffered in memory and flushed once a second as one columnar
+// block: a per-block dictionary of user ids and card keys, then one column
+// each for timestamps (zigzag varint deltas), user and card ordinals
+// (varints), outcomes (a bitmap) and latencies (varints). Blocks are appended
+// to size-capped segment files named after their first event, and segments
+// older than the retention window are deleted.
+//
+// Flushing also folds the block into per-user minute and day rollups, which
+// are all that history queries read. Rollups are saved next to the segments
+// because segment retention is much shorter than day-rollup retention: each
+// flush appends the buckets it changed to a journal, and once the journal
+// outgrows the last snapshot the tables are written out whole (to a temp
+// file renamed into place) and the journal starts over.
+namespace eventlog {
+
+struct StudyEvent {
+    std::string user_id;
+    std::string card_key; // "set_id/card_id"
+    uint64_t timestamp_ms = 0;
+    bool correct = false;
+    uint32_t latency_ms = 0;
+};
+
+struct Rollup {
+    uint32_t attempts = 0;
+    uint32_t correct = 0;
+    uint64_t latency_ms_sum = 0;
+};
+
+struct Options {
+    std::string directory = "events";
+    size_t rollup_journal_min_bytes = 1024 * 1024; // compact no sooner than this
+    size_t segment_max_bytes = 8 * 1024 * 1024;
+    int64_t segment_retention_seconds = 90LL * 24 * 60 * 60;
+    int64_t minute_rollup_retention_seconds = 2LL * 24 * 60 * 60;
+    int64_t day_rollup_retention_seconds = 2LL * 365 * 24 * 60 * 60;
+};
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+inline bool get_varint(const std::string& in, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        uint8_t b = static_cast<uint8_t>(in[pos++]);
+        v |= uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline uint64_t zigzag(int64_t v) { return (uint64_t(v) << 1) ^ uint64_t(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return int64_t(v >> 1) ^ -int64_t(v & 1); }
+
+// Encodes events as one self-contained block, prefixed by its length.
+inline std::string encode_block(const std::vector<StudyEvent>& events) {
+    std::unordered_map<std::string, uint64_t> users, cards;
+    std::vector<const std::string*> user_dict, card_dict;
+    std::vector<uint64_t> user_col, card_col;
+    for (const auto& e : events) {
+        auto u = users.emplace(e.user_id, user_dict.size());
+        if (u.second) user_dict.push_back(&e.user_id);
+        user_col.push_back(u.first->second);
+        auto c = cards.emplace(e.card_key, card_dict.size());
+        if (c.second) card_dict.push_back(&e.card_key);
+        card_col.push_back(c.first->second);
+    }
+
+    std::string body;
+    put_varint(body, events.size());
+    for (const auto* dict : {&user_dict, &card_dict}) {
+        put_varint(body, dict->size());
+        for (const std::string* s : *dict) {
+            put_varint(body, s->size());
+            body += *s;
+        }
+    }
+    uint64_t prev = 0;
+    for (const auto& e : events) {
+        put_varint(body, zigzag(int64_t(e.timestamp_ms - prev)));
+        prev = e.timestamp_ms;
+    }
+    for (uint64_t u : user_col) put_varint(body, u);
+    for (uint64_t c : card_col) put_varint(body, c);
+    std::string outcomes((events.size() + 7) / 8, '\0');
+    for (size_t i = 0; i < events.size(); i++) {
+        if (events[i].correct) outcomes[i / 8] |= static_cast<char>(1 << (i % 8));
+    }
+    body += outcomes;
+    for (const auto& e : events) put_varint(body, e.latency_ms);
+
+    std::string block;
+    put_varint(block, body.size());
+    return block + body;
+}
+
+// Decodes every block in a segment file's contents. Stops at the first
+// truncated or malformed block, which can only be the tail of a crashed write.
+inline std::vector<StudyEvent> decode_segment(const std::string& data) {
+    std::vector<StudyEvent> out;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        uint64_t len = 0;
+        if (!get_varint(data, pos, len) || pos + len > data.size()) break;
+        std::string body = data.substr(pos, len);
+        pos += len;
+
+        size_t p = 0;
+        uint64_t n = 0;
+        if (!get_varint(body, p, n)) break;
+        std::vector<std::string> dicts[2];
+        bool ok = true;
+        for (auto& dict : dicts) {
+            uint64_t count = 0;
+            ok = ok && get_varint(body, p, count);
+            for (uint64_t i = 0; ok && i < count; i++) {
+                uint64_t slen = 0;
+                ok = get_varint(body, p, slen) && p + slen <= body.size();
+                if (ok) dict.push_back(body.substr(p, slen));
+                p += slen;
+            }
+        }
+        std::vector<StudyEvent> block(ok ? n : 0);
+        uint64_t ts = 0, v = 0;
+        for (auto& e : block) {
+            ok = ok && get_varint(body, p, v);
+            ts += unzigzag(v);
+            e.timestamp_ms = ts;
+        }
+        for (auto& e : block) {
+            ok = ok && get_varint(body, p, v) && v < dicts[0].size();
+            if (ok) e.user_id = dicts[0][v];
+        }
+        for (auto& e : block) {
+            ok = ok && get_varint(body, p, v) && v < dicts[1].size();
+            if (ok) e.card_key = dicts[1][v];
+        }
+        size_t bitmap = p;
+        p += (n + 7) / 8;
+        ok = ok && p <= body.size();
+        for (size_t i = 0; ok && i < block.size(); i++) {
+            block[i].correct = (body[bitmap + i / 8] >> (i % 8)) & 1;
+        }
+        for (auto& e : block) {
+            ok = ok && get_varint(body, p, v);
+            e.latency_ms = static_cast<uint32_t>(v);
+        }
+        if (!ok) break;
+        out.insert(out.end(), block.begin(), block.end());
+    }
+    return out;
+}
+
+class EventLog {
+public:
+    static const int64_t MINUTE = 60;
+    static const int64_t DAY = 24 * 60 * 60;
+
+    explicit EventLog(Options options = Options()) : options_(options) {}
+
+    void append(StudyEvent event) {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        pending_.push_back(std::move(event));
+    }
+
+    // Writes buffered events as one block, updates rollups and applies
+    // retention. Called from the maintenance thread.
+    void flush(int64_t now) {
+        std::vector<StudyEvent> events;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            events.swap(pending_);
+        }
+        if (events.empty()) {
+            return;
+        }
+
+        write_block(events);
+        std::string journal;
+        {
+            std::lock_guard<std::mutex> lock(rollup_mutex_);
+            std::set<std::pair<std::string, int64_t>> touched_minutes, touched_days;
+            for (const auto& e : events) {
+                int64_t seconds = static_cast<int64_t>(e.timestamp_ms / 1000);
+                add(minutes_[e.user_id][seconds - seconds % MINUTE], e);
+                add(days_[e.user_id][seconds - seconds % DAY], e);
+                touched_minutes.emplace(e.user_id, seconds - seconds % MINUTE);
+                touched_days.emplace(e.user_id, seconds - seconds % DAY);
+            }
+            prune(minutes_, now - options_.minute_rollup_retention_seconds);
+            prune(days_, now - options_.day_rollup_retention_seconds);
+            append_journal(journal, "m", minutes_, touched_minutes);
+            append_journal(journal, "d", days_, touched_days);
+        }
+        save_rollups(journal);
+        drop_expired_segments(now);
+    }
+
+    // Rollups for one user with bucket start in [from, to], keyed by bucket start.
+    std::map<int64_t, Rollup> history(const std::string& user_id, bool by_day, int64_t from, int64_t to) {
+        std::lock_guard<std::mutex> lock(rollup_mutex_);
+        auto& table = by_day ? days_ : minutes_;
+        auto user = table.find(user_id);
+        if (user == table.end()) {
+            return {};
+        }
+        return std::map<int64_t, Rollup>(user->second.lower_bound(from), user->second.upper_bound(to));
+    }
+
+    // Restores rollups from the snapshot plus the journal written since.
+    // Without a usable snapshot they are rebuilt from the segments still on
+    // disk; the journal is replayed either way, as its rows are absolute
+    // bucket values that may predate the oldest segment.
+    void load() {
+        std::error_code ec;
+        std::filesystem::create_directories(options_.directory, ec);
+        bool loaded = false;
+        std::ifstream i(rollups_path());
+        if (i.is_open()) {
+            try {
+                nlohmann::json j;
+                i >> j;
+                Table minutes, days;
+                read_table(j.at("minutes"), minutes);
+                read_table(j.at("days"), days);
+                std::lock_guard<std::mutex> lock(rollup_mutex_);
+                minutes_.swap(minutes);
+                days_.swap(days);
+                loaded = true;
+            } catch (const nlohmann::json::exception& e) {
+                logging::error("event_rollups_parse_failed").str("file", rollups_path()).str("error", e.what());
+            }
+            snapshot_bytes_ = static_cast<size_t>(std::filesystem::file_size(rollups_path(), ec));
+        }
+        if (!loaded) {
+            rebuild_rollups();
+        }
+        replay_journal();
+        if (!loaded && (!minutes_.empty() || !days_.empty())) {
+            // Snapshot what was rebuilt so the next start need not rebuild.
+            compact_rollups();
+        }
+    }
+
+private:
+    using Table = std::unordered_map<std::string, std::map<int64_t, Rollup>>;
+
+    static void add(Rollup& r, const StudyEvent& e) {
+        r.attempts++;
+        if (e.correct) r.correct++;
+        r.latency_ms_sum += e.latency_ms;
+    }
+
+    static void prune(Table& table, int64_t cutoff) {
+        for (auto& user : table) {
+            user.second.erase(user.second.begin(), user.second.lower_bound(cutoff));
+        }
+    }
+
+    // Recomputes rollups from whatever segments are still on disk, for when
+    // rollups.json is missing or unreadable.
+    void rebuild_rollups() {
+        std::error_code ec;
+        std::lock_guard<std::mutex> lock(rollup_mutex_);
+        for (const auto& entry : std::filesystem::directory_iterator(options_.directory, ec)) {
+            if (entry.path().extension() != ".seg") continue;
+            std::ifstream in(entry.path(), std::ios::binary);
+            std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            for (const auto& e : decode_segment(data)) {
+                int64_t seconds = static_cast<int64_t>(e.timestamp_ms / 1000);
+                add(minutes_[e.user_id][seconds - seconds % MINUTE], e);
+                add(days_[e.user_id][seconds - seconds % DAY], e);
+            }
+        }
+    }
+
+    std::string rollups_path() const { return options_.directory + "/rollups.json"; }
+    std::string journal_path() const { return options_.directory + "/rollups.journal"; }
+
+    // One line per changed bucket: ["m"|"d", user_id, bucket_start, attempts,
+    // correct, latency_ms_sum]. Called with rollup_mutex_ held.
+    static void append_journal(std::string& out, const char* kind, const Table& table,
+                               const std::set<std::pair<std::string, int64_t>>& touched) {
+        for (const auto& key : touched) {
+            auto user = table.find(key.first);
+            if (user == table.end()) continue;
+            auto bucket = user->second.find(key.second);
+            if (bucket == user->second.end()) continue; // already past retention
+            const Rollup& r = bucket->second;
+            out += nlohmann::json::array({kind, key.first, key.second, r.attempts, r.correct, r.latency_ms_sum}).dump();
+            out += '\n';
+        }
+    }
+
+    // Applies journal rows in order, stopping at a torn last line.
+    void replay_journal() {
+        std::ifstream in(journal_path());
+        if (!in.is_open()) return;
+        std::lock_guard<std::mutex> lock(rollup_mutex_);
+        std::string line;
+        size_t rows = 0;
+        while (std::getline(in, line)) {
+            nlohmann::json row = nlohmann::json::parse(line, nullptr, false);
+            if (row.is_discarded() || !row.is_array() || row.size() != 6) break;
+            try {
+                Table& table = row.at(0).get<std::string>() == "d" ? days_ : minutes_;
+                Rollup& r = table[row.at(1).get<std::string>()][row.at(2).get<int64_t>()];
+                r.attempts = row.at(3);
+                r.correct = row.at(4);
+                r.latency_ms_sum = row.at(5);
+                rows++;
+            } catch (const nlohmann::json::exception&) {
+                break;
+            }
+        }
+        std::error_code ec;
+        journal_bytes_ = static_cast<size_t>(std::filesystem::file_size(journal_path(), ec));
+        if (rows) logging::info("event_rollups_journal_replayed").num("rows", rows);
+    }
+
+    void write_block(const std::vector<StudyEvent>& events) {
+        std::string block = encode_block(events);
+        if (segment_path_.empty() || segment_bytes_ + block.size() > options_.segment_max_bytes) {
+            segment_path_ = options_.directory + "/events-" + std::to_string(events.front().timestamp_ms) + ".seg";
+            segment_bytes_ = 0;
+        }
+        std::ofstream o(segment_path_, std::ios::binary | std::ios::app);
+        if (!o.is_open()) {
+            logging::error("event_segment_write_failed").str("file", segment_path_);
+            return;
+        }
+        o.write(block.data(), block.size());
+        segment_bytes_ += block.size();
+    }
+
+    // "events-<first timestamp ms>.seg"; anything else in the directory is
+    // left alone.
+    static bool parse_segment_name(const std::string& name, uint64_t& first_ms) {
+        const std::string prefix = "events-", suffix = ".seg";
+        if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            return false;
+        }
+        std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (digits.size() > 19 || !std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            return false;
+        }
+        first_ms = std::stoull(digits);
+        return true;
+    }
+
+    // A segment's name carries its first timestamp, so every segment except
+    // the newest is bounded by the name of the one after it.
+    void drop_expired_segments(int64_t now) {
+        std::vector<std::pair<uint64_t, std::filesystem::path>> segments;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(options_.directory, ec)) {
+            std::string name = entry.path().filename().string();
+            uint64_t first_ms;
+            if (parse_segment_name(name, first_ms)) {
+                segments.emplace_back(first_ms, entry.path());
+            }
+        }
+        std::sort(segments.begin(), segments.end());
+        uint64_t cutoff_ms = static_cast<uint64_t>(now - options_.segment_retention_seconds) * 1000;
+        for (size_t i = 0; i + 1 < segments.size() && segments[i + 1].first < cutoff_ms; i++) {
+            std::filesystem::remove(segments[i].second, ec);
+        }
+    }
+
+    // Appends the flush's journal rows, and compacts once the journal is
+    // bigger than both the last snapshot and rollup_journal_min_bytes, so
+    // the cost of rewriting the tables is spread over at least as many bytes
+    // of journal.
+    void save_rollups(const std::string& journal) {
+        {
+            std::ofstream o(journal_path(), std::ios::binary | std::ios::app);
+            if (!o.is_open()) {
+                logging::error("event_rollups_write_failed").str("file", journal_path());
+                return;
+            }
+            o.write(journal.data(), journal.size());
+            journal_bytes_ += journal.size();
+        }
+        if (journal_bytes_ >= std::max(snapshot_bytes_, options_.rollup_journal_min_bytes)) {
+            compact_rollups();
+        }
+    }
+
+    // Writes the whole tables to a temp file, renames it over rollups.json
+    // and empties the journal.
+    void compact_rollups() {
+        nlohmann::json j;
+        {
+            std::lock_guard<std::mutex> lock(rollup_mutex_);
+            j["minutes"] = write_table(minutes_);
+            j["days"] = write_table(days_);
+        }
+        std::string text = j.dump() + "\n";
+        std::string tmp = rollups_path() + ".tmp";
+        {
+            std::ofstream o(tmp, std::ios::binary | std::ios::trunc);
+            o.write(text.data(), text.size());
+            if (!o) {
+                logging::error("event_rollups_write_failed").str("file", tmp);
+                return;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, rollups_path(), ec);
+        if (ec) {
+            logging::error("event_rollups_write_failed").str("file", rollups_path()).str("error", ec.message());
+            return;
+        }
+        // A crash before this truncation only replays rows the snapshot
+        // already holds, which is harmless.
+        std::ofstream(journal_path(), std::ios::binary | std::ios::trunc);
+        snapshot_bytes_ = text.size();
+        journal_bytes_ = 0;
+    }
+
+    // {user_id: [[bucket_start, attempts, correct, latency_ms_sum], ...]}
+    static nlohmann::json write_table(const Table& table) {
+        nlohmann::json j = nlohmann::json::object();
+        for (const auto& user : table) {
+            nlohmann::json rows = nlohmann::json::array();
+            for (const auto& bucket : user.second) {
+                const Rollup& r = bucket.second;
+                rows.push_back({bucket.first, r.attempts, r.correct, r.latency_ms_sum});
+            }
+            j[user.first] = rows;
+        }
+        return j;
+    }
+
+    static void read_table(const nlohmann::json& j, Table& table) {
+        for (const auto& user : j.items()) {
+            auto& buckets = table[user.key()];
+            for (const auto& row : user.value()) {
+                Rollup& r = buckets[row.at(0).get<int64_t>()];
+                r.attempts = row.at(1);
+                r.correct = row.at(2);
+                r.latency_ms_sum = row.at(3);
+            }
+        }
+    }
+
+    Options options_;
+
+    std::mutex pending_mutex_;
+    std::vector<StudyEvent> pending_;
+
+    // Only touched by flush(), which runs on the maintenance thread.
+    std::string segment_path_;
+    size_t segment_bytes_ = 0;
+    size_t journal_bytes_ = 0;
+    size_t snapshot_bytes_ = 0;
+
+    std::mutex rollup_mutex_;
+    Table minutes_;
+    Table days_;
+};
+
+} // namespace eventlog
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+
+// Request lanes. Every request is classified into a lane and must hold one
+// of a fixed number of run slots while its handler runs. Each lane has its
+// own budget (the most slots it may hold at once) and waiting room; when a
+// slot frees, waiting lanes are served in strict priority order, so a burst
+// in a lower-priority lane can neither take more than its budget nor delay
+// a higher-priority lane by more than the slots it already holds.
+//
+// A request that finds its lane's waiting room full, or that waits past the
+// deadline, is refused so the caller can answer 503.
+namespace lanes {
+
+// In priority order, highest first.
+enum Lane { READ, WRITE, EXPENSIVE, LANES };
+
+inline const char* lane_name(Lane lane) {
+    static const char* names[LANES] = {"read", "write", "expensive"};
+    return names[lane];
+}
+
+struct LaneOptions {
+    size_t budget = 1;      // slots the lane may hold at once
+    size_t max_waiting = 1; // requests that may wait for a slot
+};
+
+struct Options {
+    size_t slots = 2; // requests running at once across all lanes
+    LaneOptions lanes[LANES];
+    std::chrono::milliseconds max_wait{1000};
+};
+
+class LaneScheduler {
+public:
+    enum Outcome { ADMITTED, QUEUE_FULL, TIMED_OUT };
+
+    struct LaneStats {
+        size_t running = 0;
+        size_t waiting = 0;
+        uint64_t admitted = 0;
+        uint64_t queue_full = 0;
+        uint64_t timed_out = 0;
+    };
+
+    void configure(const Options& options) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options_ = options;
+    }
+
+    // Blocks until the request may run in its lane, or refuses it. Every
+    // ADMITTED acquire must be paired with release().
+    Outcome acquire(Lane lane) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        State& state = lanes_[lane];
+        if (state.waiters.empty() && can_run(lane)) {
+            admit(lane);
+            return ADMITTED;
+        }
+        if (state.waiters.size() >= options_.lanes[lane].max_waiting) {
+            state.stats.queue_full++;
+            return QUEUE_FULL;
+        }
+        Waiter waiter;
+        auto it = state.waiters.insert(state.waiters.end(), &waiter);
+        if (!waiter.cond.wait_for(lock, options_.max_wait, [&waiter] { return waiter.granted; })) {
+            state.waiters.erase(it);
+            state.stats.timed_out++;
+            // Leaving may unblock a lower-priority lane this one was
+            // holding back.
+            dispatch();
+            return TIMED_OUT;
+        }
+        return ADMITTED;
+    }
+
+    void release(Lane lane) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lanes_[lane].stats.running--;
+        running_--;
+        dispatch();
+    }
+
+    LaneStats stats(Lane lane) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        LaneStats s = lanes_[lane].stats;
+        s.waiting = lanes_[lane].waiters.size();
+        return s;
+    }
+
+private:
+    struct Waiter {
+        std::condition_variable cond;
+        bool granted = false;
+    };
+
+    struct State {
+        std::list<Waiter*> waiters; // FIFO
+        LaneStats stats;
+    };
+
+    // Called with mutex_ held.
+    bool can_run(Lane lane) const {
+        if (running_ >= options_.slots || lanes_[lane].stats.running >= options_.lanes[lane].budget) return false;
+        // A higher-priority lane with waiters it could run goes first.
+        for (int higher = 0; higher < lane; higher++) {
+            const State& h = lanes_[higher];
+            if (!h.waiters.empty() && h.stats.running < options_.lanes[higher].budget) return false;
+        }
+        return true;
+    }
+
+    void admit(Lane lane) {
+        lanes_[lane].stats.running++;
+        lanes_[lane].stats.admitted++;
+        running_++;
+    }
+
+    // Hands free slots to waiters, highest priority first. Called with
+    // mutex_ held.
+    void dispatch() {
+        for (int l = 0; l < LANES && running_ < options_.slots; l++) {
+            State& state = lanes_[l];
+            while (!state.waiters.empty() && running_ < options_.slots &&
+                   state.stats.running < options_.lanes[l].budget) {
+                Waiter* waiter = state.waiters.front();
+                state.waiters.pop_front();
+                admit(static_cast<Lane>(l));
+                waiter->granted = true;
+                waiter->cond.notify_one();
+            }
+        }
+    }
+
+    Options options_; // written before the server starts
+    mutable std::mutex mutex_; // guards everything
+    State lanes_[LANES];
+    size_t running_ = 0;
+};
+
+} // namespace lanes
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Asynchronous structured logging. A log line is built on the caller's
+// stack (fields are rendered as JSON into a fixed buffer, no allocation)
+// and copied into the calling thread's single-producer ring; a background
+// writer drains every ring, orders lines by time and writes them to stdout
+// as JSON, one object per line, with a single flush per batch. A full ring
+// drops the line and counts it rather than block the caller.
+//
+// Usage: logging::info("data_saved").str("file", DATA_FILE).num("ms", ms);
+// The line is queued when the temporary is destroyed. Event names must be
+// string literals.
+//
+// FLIPIT_LOG_LEVEL (debug|info|warn|error) sets the minimum level, and
+// FLIPIT_LOG_RATE caps lines per event per second (0 = no cap); lines over
+// the cap are counted and reported in a log_suppressed line.
+namespace logging {
+
+enum class Level : uint8_t { Debug, Info, Warn, Error };
+
+namespace detail {
+
+struct Record {
+    static const size_t FIELDS = 228;
+
+    int64_t timestamp_ns = 0;
+    Level level = Level::Info;
+    bool rate_limited = true;
+    uint16_t length = 0; // bytes used in fields
+    const char* event = "";
+    char fields[FIELDS]; // pre-rendered ,"key":value pairs
+};
+
+class Ring {
+public:
+    static const uint32_t CAPACITY = 512;
+
+    bool push(const Record& record) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == CAPACITY) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head % CAPACITY] = record;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename Fn>
+    void drain(Fn fn) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        for (; tail != head; tail++) fn(slots_[tail % CAPACITY]);
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> orphaned{false}; // owning thread has exited
+
+private:
+    Record slots_[CAPACITY];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+};
+
+class Writer {
+public:
+    std::atomic<int> min_level{static_cast<int>(Level::Info)};
+
+    std::shared_ptr<Ring> add_ring() {
+        auto ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.push_back(ring);
+        return ring;
+    }
+
+    void start() {
+        if (const char* level = std::getenv("FLIPIT_LOG_LEVEL")) {
+            std::string l = level;
+            min_level = static_cast<int>(l == "debug" ? Level::Debug : l == "warn" ? Level::Warn
+                                         : l == "error" ? Level::Error : Level::Info);
+        }
+        if (const char* rate = std::getenv("FLIPIT_LOG_RATE")) {
+            rate_limit_ = std::strtoul(rate, nullptr, 10);
+        }
+        thread_ = std::thread([this] {
+            while (!stop_) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                drain();
+            }
+            drain();
+        });
+    }
+
+    void shutdown() {
+        if (thread_.joinable()) {
+            stop_ = true;
+            thread_.join();
+        }
+    }
+
+private:
+    void drain() {
+        std::vector<Record> batch;
+        std::vector<uint64_t> drops;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            for (size_t i = 0; i < rings_.size();) {
+                Ring& ring = *rings_[i];
+                bool orphaned = ring.orphaned.load(std::memory_order_acquire);
+                ring.drain([&batch](const Record& r) { batch.push_back(r); });
+                if (uint64_t n = ring.dropped.exchange(0)) drops.push_back(n);
+                if (orphaned) {
+                    rings_.erase(rings_.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+        }
+        std::stable_sort(batch.begin(), batch.end(),
+                         [](const Record& a, const Record& b) { return a.timestamp_ns < b.timestamp_ns; });
+
+        std::string out;
+        int64_t now_ns = batch.empty() ? wall_ns() : batch.back().timestamp_ns;
+        int64_t second = now_ns / 1000000000;
+        if (second != window_) {
+            for (const auto& s : suppressed_) {
+                if (!s.second) continue;
+                out += "{\"ts\":\"" + timestamp(now_ns) + "\",\"level\":\"warn\",\"event\":\"log_suppressed\",\"suppressed_event\":\"" +
+                       s.first + "\",\"count\":" + std::to_string(s.second) + "}\n";
+            }
+            suppressed_.clear();
+            counts_.clear();
+            window_ = second;
+        }
+        for (uint64_t count : drops) {
+            out += "{\"ts\":\"" + timestamp(now_ns) + "\",\"level\":\"warn\",\"event\":\"log_dropped\",\"count\":" +
+                   std::to_string(count) + "}\n";
+        }
+        for (const Record& r : batch) {
+            if (r.rate_limited && rate_limit_ && ++counts_[r.event] > rate_limit_) {
+                suppressed_[r.event]++;
+                continue;
+            }
+            static const char* names[] = {"debug", "info", "warn", "error"};
+            out += "{\"ts\":\"" + timestamp(r.timestamp_ns) + "\",\"level\":\"" + names[static_cast<int>(r.level)] +
+                   "\",\"event\":\"" + r.event + "\"";
+            out.append(r.fields, r.length);
+            out += "}\n";
+        }
+        if (!out.empty()) {
+            std::fwrite(out.data(), 1, out.size(), stdout);
+            std::fflush(stdout);
+        }
+    }
+
+    static int64_t wall_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // ISO 8601 UTC with milliseconds.
+    static std::string timestamp(int64_t ns) {
+        std::time_t seconds = static_cast<std::time_t>(ns / 1000000000);
+        std::tm tm{};
+        gmtime_r(&seconds, &tm);
+        char buf[40];
+        size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+        std::snprintf(buf + n, sizeof(buf) - n, ".%03dZ", static_cast<int>(ns / 1000000 % 1000));
+        return buf;
+    }
+
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    unsigned long rate_limit_ = 100;
+    int64_t window_ = 0;
+    std::map<std::string, uint64_t> counts_;     // lines per event this second
+    std::map<std::string, uint64_t> suppressed_; // lines over the cap this second
+};
+
+inline Writer& writer() {
+    static Writer* w = new Writer; // never destroyed, so late loggers stay safe
+    return *w;
+}
+
+// The calling thread's ring, marked orphaned when the thread exits so the
+// writer can drop it once drained.
+inline Ring& thread_ring() {
+    struct Holder {
+        std::shared_ptr<Ring> ring = writer().add_ring();
+        ~Holder() { ring->orphaned.store(true, std::memory_order_release); }
+    };
+    thread_local Holder holder;
+    return *holder.ring;
+}
+
+} // namespace detail
+
+class Line {
+public:
+    Line(Level level, const char* event) : active_(static_cast<int>(level) >= detail::writer().min_level.load(std::memory_order_relaxed)) {
+        if (!active_) return;
+        record_.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        record_.level = level;
+        record_.event = event;
+    }
+
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+
+    ~Line() {
+        if (active_) detail::thread_ring().push(record_);
+    }
+
+    Line& str(const char* key, const char* value, size_t length) {
+        if (!active_ || truncated_) return *this;
+        size_t mark = record_.length;
+        begin_field(key);
+        put('"');
+        for (size_t i = 0; i < length; i++) {
+            unsigned char c = static_cast<unsigned char>(value[i]);
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(static_cast<char>(c));
+            } else if (c < 0x20) {
+                char esc[8];
+                std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+                append(esc, 6);
+            } else {
+                put(static_cast<char>(c));
+            }
+        }
+        put('"');
+        if (truncated_) record_.length = static_cast<uint16_t>(mark);
+        return *this;
+    }
+
+    Line& str(const char* key, const std::string& value) { return str(key, value.data(), value.size()); }
+    Line& str(const char* key, const char* value) { return str(key, value, std::strlen(value)); }
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    Line& num(const char* key, T value) {
+        char buf[24];
+        return raw(key, buf, std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(value)));
+    }
+
+    Line& num(const char* key, double value) {
+        char buf[32];
+        return raw(key, buf, std::snprintf(buf, sizeof(buf), "%.6g", value));
+    }
+
+    // Exempts the line from the per-event rate cap (e.g. the access log).
+    Line& unlimited() {
+        record_.rate_limited = false;
+        return *this;
+    }
+
+private:
+    Line& raw(const char* key, const char* value, size_t length) {
+        if (!active_ || truncated_) return *this;
+        size_t mark = record_.length;
+        begin_field(key);
+        append(value, length);
+        if (truncated_) record_.length = static_cast<uint16_t>(mark);
+        return *this;
+    }
+
+    void begin_field(const char* key) {
+        put(',');
+        put('"');
+        append(key, std::strlen(key));
+        put('"');
+        put(':');
+    }
+
+    // A field that does not fit is rolled back, and later fields are
+    // skipped, so the line stays valid JSON.
+    void put(char c) {
+        if (record_.length < detail::Record::FIELDS) record_.fields[record_.length++] = c;
+        else truncated_ = true;
+    }
+
+    void append(const char* data, size_t n) {
+        for (size_t i = 0; i < n; i++) put(data[i]);
+    }
+
+    bool active_;
+    bool truncated_ = false;
+    detail::Record record_;
+};
+
+inline Line debug(const char* event) { return Line(Level::Debug, event); }
+inline Line info(const char* event) { return Line(Level::Info, event); }
+inline Line warn(const char* event) { return Line(Level::Warn, event); }
+inline Line error(const char* event) { return Line(Level::Error, event); }
+
+inline void start() { detail::writer().start(); }
+inline void shutdown() { detail::writer().shutdown(); }
+
+} // namespace logging
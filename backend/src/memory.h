@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Memory accounting. Each owner of in-memory state reports byte deltas as it
+// grows and shrinks, and the ledger keeps running totals per subsystem, per
+// user and per set, so a report never walks the data it describes.
+//
+// Sizes are estimates of what the allocator hands out for our containers:
+// object sizes plus out-of-line string buffers plus a fixed per-node cost
+// for hash and tree containers. They track growth and relative footprint
+// well; they do not include allocator slack or vector spare capacity.
+namespace memory {
+
+// libstdc++ keeps strings of up to 15 characters inline.
+inline size_t heap_bytes(const std::string& s) { return s.size() > 15 ? s.size() + 1 : 0; }
+inline size_t string_bytes(const std::string& s) { return sizeof(std::string) + heap_bytes(s); }
+
+// Per-element overhead of std::unordered_map (next pointer, cached hash and
+// a share of the bucket array) and of std::map/std::set (colour and three
+// links), on top of the stored value.
+const size_t HASH_NODE_BYTES = 3 * sizeof(void*);
+const size_t TREE_NODE_BYTES = 4 * sizeof(void*);
+
+enum Subsystem {
+    USERS,
+    SETS,
+    CARDS,
+    STATS,
+    SESSIONS,
+    DISTRACTOR_INDEX,
+    DUPLICATE_INDEX,
+    RELATED_INDEX,
+    SUGGEST_INDEX,
+    TAG_INDEX,
+    QUIZ_SAMPLER_CACHE,
+    SUBSYSTEMS
+};
+
+inline const char* subsystem_name(Subsystem s) {
+    static const char* names[SUBSYSTEMS] = {"users", "sets", "cards", "stats", "sessions", "distractor_index",
+                                            "duplicate_index", "related_index", "suggest_index", "tag_index",
+                                            "quiz_sampler_cache"};
+    return names[s];
+}
+
+class Ledger {
+public:
+    struct Report {
+        int64_t totals[SUBSYSTEMS];
+        std::vector<std::pair<std::string, int64_t>> top_users;
+        std::vector<std::pair<std::string, int64_t>> top_sets;
+    };
+
+    // Adds delta bytes to a subsystem and to the owning user and set; either
+    // owner may be empty when the bytes are not attributed to one.
+    void charge(Subsystem subsystem, const std::string& user_id, const std::string& set_id, int64_t delta) {
+        if (delta == 0) return;
+        totals_[subsystem].fetch_add(delta, std::memory_order_relaxed);
+        if (user_id.empty() && set_id.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!user_id.empty()) users_.add(user_id, delta);
+        if (!set_id.empty()) sets_.add(set_id, delta);
+    }
+
+    // Drops a deleted set's row (its bytes are expected to be charged back
+    // to zero already; anything left is a leak in the estimates, not memory).
+    void forget_set(const std::string& set_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sets_.erase(set_id);
+    }
+
+    Report report(size_t top_n) const {
+        Report r;
+        for (int s = 0; s < SUBSYSTEMS; s++) r.totals[s] = totals_[s].load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex_);
+        r.top_users = users_.top(top_n);
+        r.top_sets = sets_.top(top_n);
+        return r;
+    }
+
+private:
+    // Bytes per owner, plus the same pairs ordered by size so the top N is a
+    // walk from the largest end.
+    class Ranking {
+    public:
+        void add(const std::string& id, int64_t delta) {
+            auto it = bytes_.find(id);
+            if (it == bytes_.end()) it = bytes_.emplace(id, 0).first;
+            else by_size_.erase({it->second, id});
+            it->second += delta;
+            by_size_.insert({it->second, id});
+        }
+
+        void erase(const std::string& id) {
+            auto it = bytes_.find(id);
+            if (it == bytes_.end()) return;
+            by_size_.erase({it->second, id});
+            bytes_.erase(it);
+        }
+
+        std::vector<std::pair<std::string, int64_t>> top(size_t n) const {
+            std::vector<std::pair<std::string, int64_t>> out;
+            for (auto it = by_size_.rbegin(); it != by_size_.rend() && out.size() < n; ++it) {
+                out.emplace_back(it->second, it->first);
+            }
+            return out;
+        }
+
+    private:
+        std::unordered_map<std::string, int64_t> bytes_;
+        std::set<std::pair<int64_t, std::string>> by_size_;
+    };
+
+    std::atomic<int64_t> totals_[SUBSYSTEMS] = {};
+    mutable std::mutex mutex_; // guards users_ and sets_; never held while taking another lock
+    Ranking users_;
+    Ranking sets_;
+};
+
+} // namespace memory
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+// HDR-style log-linear latency histogram in microseconds: exact below 8us,
+// then SUB buckets per power of two, so any recorded value is known to
+// within 25%. Each instance has a single writer thread, which bumps its
+// counters with plain relaxed load/store pairs (no locked instructions);
+// scrapers read them concurrently with relaxed loads.
+class Histogram {
+public:
+    static const int SUB = 4;
+    static const int BUCKETS = SUB * 32;
+
+    struct Snapshot {
+        std::array<uint64_t, BUCKETS> counts{};
+        uint64_t sum_us = 0;
+        uint64_t count = 0;
+
+        // Upper edge of the bucket holding the q-th quantile.
+        uint64_t quantile_us(double q) const {
+            uint64_t rank = static_cast<uint64_t>(q * count);
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; i++) {
+                seen += counts[i];
+                if (seen > rank) return upper_bound(i);
+            }
+            return upper_bound(BUCKETS - 1);
+        }
+    };
+
+    static int bucket(uint64_t us) {
+        if (us < 2 * SUB) return static_cast<int>(us);
+        int e = 63 - __builtin_clzll(us);
+        int i = (e - 1) * SUB + static_cast<int>((us >> (e - 2)) & (SUB - 1));
+        return i < BUCKETS ? i : BUCKETS - 1;
+    }
+
+    // Exclusive upper edge of bucket i, in microseconds.
+    static uint64_t upper_bound(int i) {
+        if (i < 2 * SUB) return static_cast<uint64_t>(i) + 1;
+        int e = i / SUB + 1;
+        return static_cast<uint64_t>(SUB + 1 + i % SUB) << (e - 2);
+    }
+
+    void record(uint64_t us) {
+        bump(counts_[bucket(us)], 1);
+        bump(sum_us_, us);
+    }
+
+    void snapshot_into(Snapshot& out) const {
+        for (int i = 0; i < BUCKETS; i++) {
+            uint64_t n = counts_[i].load(std::memory_order_relaxed);
+            out.counts[i] += n;
+            out.count += n;
+        }
+        out.sum_us += sum_us_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static void bump(std::atomic<uint64_t>& counter, uint64_t by) {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+    std::atomic<uint64_t> sum_us_{0};
+};
+
+// A Prometheus histogram family. Each recording thread owns its series and
+// publishes new ones on a lock-free list, so record() touches only
+// thread-local data; render() walks every thread's list and merges series
+// with equal labels. Per-thread state lives for the life of the process.
+class HistogramFamily {
+public:
+    HistogramFamily(std::string name, std::string help) : name_(std::move(name)), help_(std::move(help)) {}
+
+    // labels is the rendered label set, e.g. method="GET",status="200".
+    void record(const std::string& labels, uint64_t us) {
+        ThreadSeries& local = thread_series();
+        auto it = local.by_labels.find(labels);
+        if (it == local.by_labels.end()) {
+            Series* series = new Series{labels, {}, local.head.load(std::memory_order_relaxed)};
+            local.head.store(series, std::memory_order_release);
+            it = local.by_labels.emplace(labels, series).first;
+        }
+        it->second->histogram.record(us);
+    }
+
+    std::map<std::string, Histogram::Snapshot> snapshot() const {
+        std::map<std::string, Histogram::Snapshot> merged;
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        for (const ThreadSeries* t : threads_) {
+            for (const Series* s = t->head.load(std::memory_order_acquire); s; s = s->next) {
+                s->histogram.snapshot_into(merged[s->labels]);
+            }
+        }
+        return merged;
+    }
+
+    // Cumulative buckets at every power of two from 64us to ~16s, which are
+    // exact bucket edges, plus p50/p90/p99 gauges read from the fine buckets.
+    void render(std::ostream& out) const {
+        auto merged = snapshot();
+        out << "# HELP " << name_ << " " << help_ << "\n# TYPE " << name_ << " histogram\n";
+        for (const auto& series : merged) {
+            const Histogram::Snapshot& snap = series.second;
+            std::string sep = series.first.empty() ? "" : ",";
+            uint64_t cumulative = 0;
+            int i = 0;
+            for (uint64_t edge = 64; edge <= (uint64_t(1) << 24); edge <<= 1) {
+                for (; i < Histogram::BUCKETS && Histogram::upper_bound(i) <= edge; i++) cumulative += snap.counts[i];
+                out << name_ << "_bucket{" << series.first << sep << "le=\"" << seconds(edge) << "\"} " << cumulative << "\n";
+            }
+            out << name_ << "_bucket{" << series.first << sep << "le=\"+Inf\"} " << snap.count << "\n";
+            out << name_ << "_sum{" << series.first << "} " << seconds(snap.sum_us) << "\n";
+            out << name_ << "_count{" << series.first << "} " << snap.count << "\n";
+        }
+
+        std::string quantiles = name_ + "_quantile";
+        out << "# HELP " << quantiles << " Quantiles of " << name_ << " to within 25%.\n# TYPE " << quantiles << " gauge\n";
+        for (const auto& series : merged) {
+            std::string sep = series.first.empty() ? "" : ",";
+            for (const char* q : {"0.5", "0.9", "0.99"}) {
+                out << quantiles << "{" << series.first << sep << "quantile=\"" << q << "\"} "
+                    << seconds(series.second.quantile_us(std::stod(q))) << "\n";
+            }
+        }
+    }
+
+private:
+    struct Series {
+        std::string labels;
+        Histogram histogram;
+        Series* next;
+    };
+
+    struct ThreadSeries {
+        std::atomic<Series*> head{nullptr};
+        std::unordered_map<std::string, Series*> by_labels; // owner thread only
+    };
+
+    ThreadSeries& thread_series() {
+        thread_local std::unordered_map<const HistogramFamily*, ThreadSeries*> families;
+        ThreadSeries*& local = families[this];
+        if (!local) {
+            local = new ThreadSeries;
+            std::lock_guard<std::mutex> lock(threads_mutex_);
+            threads_.push_back(local);
+        }
+        return *local;
+    }
+
+    static std::string seconds(uint64_t us) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.6f", us / 1e6);
+        return buf;
+    }
+
+    std::string name_;
+    std::string help_;
+    mutable std::mutex threads_mutex_; // guards threads_ only
+    std::vector<ThreadSeries*> threads_;
+};
+
+// Records the lifetime of the scope into a histogram family.
+class ScopedTimer {
+public:
+    ScopedTimer(HistogramFamily& family, std::string labels)
+        : family_(family), labels_(std::move(labels)), start_(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        family_.record(labels_, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+private:
+    HistogramFamily& family_;
+    std::string labels_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace metrics
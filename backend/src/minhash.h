@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "memory.h"
+
+// MinHash signatures over character trigrams, bucketed with LSH banding so
+// texts with high estimated Jaccard similarity share at least one bucket.
+// Finding similar entries is a handful of bucket lookups instead of a
+// comparison against every entry.
+class MinHashIndex {
+public:
+    static const int HASHES = 32;
+    static const int BANDS = 8;
+    static const int ROWS = HASHES / BANDS;
+
+    using Signature = std::array<uint32_t, HASHES>;
+
+    struct Entry {
+        std::string key;
+        std::string group;
+        std::string text;
+        Signature signature;
+    };
+
+    struct Match {
+        const Entry* entry;
+        double similarity; // estimated Jaccard similarity in [0, 1]
+    };
+
+    static Signature signature(const std::string& text) {
+        Signature sig;
+        sig.fill(UINT32_MAX);
+        std::string padded = " ";
+        for (char c : text) padded += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        padded += " ";
+
+        size_t shingle = std::min<size_t>(3, padded.size());
+        for (size_t i = 0; i + shingle <= padded.size(); i++) {
+            uint64_t h = fnv1a(padded.data() + i, shingle);
+            for (int k = 0; k < HASHES; k++) {
+                uint32_t v = static_cast<uint32_t>((h * MULTIPLIERS[k] + k) >> 32);
+                sig[k] = std::min(sig[k], v);
+            }
+        }
+        return sig;
+    }
+
+    size_t size() const { return entries_.size(); }
+
+    // Estimated heap footprint, kept current by upsert() and remove().
+    size_t memory_bytes() const { return bytes_; }
+
+    void upsert(const std::string& key, const std::string& group, const std::string& text) {
+        remove(key);
+        Entry entry{key, group, text, signature(text)};
+        bytes_ += entry_bytes(entry);
+        size_t index = entries_.size();
+        for (int band = 0; band < BANDS; band++) {
+            buckets_[band_key(entry.signature, band)].push_back(key);
+        }
+        positions_[key] = index;
+        entries_.push_back(std::move(entry));
+    }
+
+    void remove(const std::string& key) {
+        auto pos = positions_.find(key);
+        if (pos == positions_.end()) {
+            return;
+        }
+        size_t index = pos->second;
+        bytes_ -= entry_bytes(entries_[index]);
+        for (int band = 0; band < BANDS; band++) {
+            auto bucket = buckets_.find(band_key(entries_[index].signature, band));
+            if (bucket == buckets_.end()) continue;
+            auto& keys = bucket->second;
+            keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+            if (keys.empty()) buckets_.erase(bucket);
+        }
+        positions_.erase(pos);
+        if (index + 1 != entries_.size()) {
+            entries_[index] = std::move(entries_.back());
+            positions_[entries_[index].key] = index;
+        }
+        entries_.pop_back();
+    }
+
+    const Entry* find(const std::string& key) const {
+        auto pos = positions_.find(key);
+        return pos == positions_.end() ? nullptr : &entries_[pos->second];
+    }
+
+    // Entries sharing a band bucket with `key`, most similar first.
+    std::vector<Match> similar(const std::string& key) const {
+        std::vector<Match> out;
+        const Entry* target = find(key);
+        if (!target) {
+            return out;
+        }
+        std::unordered_set<std::string> seen;
+        for (int band = 0; band < BANDS; band++) {
+            auto bucket = buckets_.find(band_key(target->signature, band));
+            if (bucket == buckets_.end()) continue;
+            for (const auto& other : bucket->second) {
+                if (other == key || !seen.insert(other).second) continue;
+                const Entry& e = entries_[positions_.at(other)];
+                int same = 0;
+                for (int k = 0; k < HASHES; k++) same += e.signature[k] == target->signature[k];
+                out.push_back({&e, double(same) / HASHES});
+            }
+        }
+        std::sort(out.begin(), out.end(), [](const Match& a, const Match& b) { return a.similarity > b.similarity; });
+        return out;
+    }
+
+    template <typename Rng>
+    const Entry* random_entry(Rng& rng) const {
+        if (entries_.empty()) return nullptr;
+        std::uniform_int_distribution<size_t> pick(0, entries_.size() - 1);
+        return &entries_[pick(rng)];
+    }
+
+private:
+    static constexpr uint64_t MULTIPLIERS[HASHES] = {
+        0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0xd6e8feb86659fd93ULL,
+        0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+        0x1d8e4e27c47d124fULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0x85ebca77c2b2ae63ULL,
+        0x27d4eb2f165667c5ULL, 0xff51afd7ed558ccdULL, 0xc4ceb9fe1a85ec53ULL, 0x87c37b91114253d5ULL,
+        0x4cf5ad432745937fULL, 0x52dce729da3ed2b5ULL, 0x38495ab5d4c4f5a7ULL, 0x9fb21c651e98df25ULL,
+        0xd3833e804f4c574bULL, 0x2127599bf4325c37ULL, 0x880355f21e6d1965ULL, 0xe220a8397b1dcdafULL,
+        0x6c62272e07bb0143ULL, 0xcbf29ce484222325ULL, 0x5851f42d4c957f2dULL, 0xa24baed4963ee407ULL,
+        0x9fb21c651e98df27ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xc949d7c7509e6557ULL};
+
+    static uint64_t fnv1a(const char* data, size_t len) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < len; i++) {
+            h ^= static_cast<uint8_t>(data[i]);
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    static uint64_t band_key(const Signature& sig, int band) {
+        uint64_t h = 0xcbf29ce484222325ULL ^ static_cast<uint64_t>(band);
+        for (int r = 0; r < ROWS; r++) {
+            h ^= sig[band * ROWS + r];
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // The entry, its positions_ slot and its key in one bucket per band.
+    static size_t entry_bytes(const Entry& e) {
+        return sizeof(Entry) + memory::heap_bytes(e.key) + memory::heap_bytes(e.group) + memory::heap_bytes(e.text) +
+               memory::HASH_NODE_BYTES + memory::string_bytes(e.key) + sizeof(size_t) +
+               BANDS * memory::string_bytes(e.key);
+    }
+
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, size_t> positions_;
+    std::unordered_map<uint64_t, std::vector<std::string>> buckets_;
+    size_t bytes_ = 0;
+};
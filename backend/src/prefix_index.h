@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+
+// Radix tree (path-compressed trie) mapping string keys to ranked ids. Every
+// node caches the TOP_K highest-ranked distinct ids in its subtree, so a
+// prefix lookup is a walk down at most prefix-length edges followed by
+// reading one cached list, independent of how many keys share the prefix.
+// Inserts and erases refresh the caches along the touched path only.
+class PrefixIndex {
+public:
+    static const size_t TOP_K = 10;
+
+    PrefixIndex() : root_(new Node), bytes_(sizeof(Node)) {}
+
+    // Estimated heap footprint, kept current by insert() and erase().
+    size_t memory_bytes() const { return bytes_; }
+
+    void insert(const std::string& key, const std::string& id, int64_t rank) {
+        std::vector<Node*> path = {root_.get()};
+        Node* node = root_.get();
+        size_t i = 0;
+        while (i < key.size()) {
+            auto it = node->children.find(key[i]);
+            if (it == node->children.end()) {
+                std::unique_ptr<Node> leaf(new Node);
+                leaf->label = key.substr(i);
+                bytes_ += node_bytes(leaf->label);
+                node = (node->children[key[i]] = std::move(leaf)).get();
+                path.push_back(node);
+                break;
+            }
+            Node* child = it->second.get();
+            size_t common = 0;
+            while (common < child->label.size() && i + common < key.size() && child->label[common] == key[i + common]) {
+                common++;
+            }
+            if (common < child->label.size()) {
+                // Split the edge so the shared part becomes its own node.
+                std::unique_ptr<Node> mid(new Node);
+                mid->label = child->label.substr(0, common);
+                mid->best = child->best;
+                bytes_ += node_bytes(mid->label) + ranked_bytes(mid->best);
+                bytes_ -= memory::heap_bytes(child->label);
+                child->label.erase(0, common);
+                bytes_ += memory::heap_bytes(child->label);
+                mid->children[child->label[0]] = std::move(it->second);
+                child = (it->second = std::move(mid)).get();
+            }
+            node = child;
+            path.push_back(node);
+            i += common;
+        }
+        node->here.emplace_back(rank, id);
+        bytes_ += sizeof(Ranked) + memory::heap_bytes(id);
+        for (auto p = path.rbegin(); p != path.rend(); ++p) {
+            bytes_ -= ranked_bytes((*p)->best);
+            (*p)->best.emplace_back(rank, id);
+            trim((*p)->best);
+            bytes_ += ranked_bytes((*p)->best);
+        }
+    }
+
+    void erase(const std::string& key, const std::string& id) {
+        std::vector<Node*> path = {root_.get()};
+        Node* node = root_.get();
+        size_t i = 0;
+        while (i < key.size()) {
+            auto it = node->children.find(key[i]);
+            if (it == node->children.end() || key.compare(i, it->second->label.size(), it->second->label) != 0) {
+                return;
+            }
+            i += it->second->label.size();
+            node = it->second.get();
+            path.push_back(node);
+        }
+        auto& here = node->here;
+        bytes_ -= ranked_bytes(here);
+        here.erase(std::remove_if(here.begin(), here.end(), [&id](const Ranked& r) { return r.second == id; }), here.end());
+        bytes_ += ranked_bytes(here);
+
+        for (size_t depth = path.size(); depth-- > 0;) {
+            Node* n = path[depth];
+            if (depth > 0) {
+                Node* parent = path[depth - 1];
+                char edge = n->label[0];
+                if (n->here.empty() && n->children.empty()) {
+                    bytes_ -= node_bytes(n->label) + ranked_bytes(n->best);
+                    parent->children.erase(edge);
+                    continue;
+                }
+                if (n->here.empty() && n->children.size() == 1) {
+                    // Re-compress: fold the only child into this node.
+                    std::unique_ptr<Node> only = std::move(n->children.begin()->second);
+                    bytes_ -= node_bytes(only->label) + ranked_bytes(only->best) + memory::heap_bytes(n->label);
+                    n->label += only->label;
+                    bytes_ += memory::heap_bytes(n->label);
+                    n->children = std::move(only->children);
+                    n->here = std::move(only->here);
+                }
+            }
+            bytes_ -= ranked_bytes(n->best);
+            n->best = n->here;
+            for (const auto& child : n->children) {
+                n->best.insert(n->best.end(), child.second->best.begin(), child.second->best.end());
+            }
+            trim(n->best);
+            bytes_ += ranked_bytes(n->best);
+        }
+    }
+
+    // Up to k (at most TOP_K) distinct ids whose keys start with prefix,
+    // highest rank first.
+    std::vector<std::string> top(const std::string& prefix, size_t k) const {
+        std::vector<std::string> out;
+        const Node* node = root_.get();
+        size_t i = 0;
+        while (i < prefix.size()) {
+            auto it = node->children.find(prefix[i]);
+            if (it == node->children.end()) {
+                return out;
+            }
+            const std::string& label = it->second->label;
+            size_t len = std::min(label.size(), prefix.size() - i);
+            if (prefix.compare(i, len, label, 0, len) != 0) {
+                return out;
+            }
+            i += len;
+            node = it->second.get();
+        }
+        for (size_t j = 0; j < node->best.size() && j < k; j++) out.push_back(node->best[j].second);
+        return out;
+    }
+
+private:
+    using Ranked = std::pair<int64_t, std::string>;
+
+    struct Node {
+        std::string label; // edge label from the parent
+        std::map<char, std::unique_ptr<Node>> children;
+        std::vector<Ranked> here; // ids whose key ends at this node
+        std::vector<Ranked> best; // top TOP_K distinct ids in this subtree
+    };
+
+    // Sorts by rank (then id), keeps each id's best entry, and cuts to TOP_K.
+    static void trim(std::vector<Ranked>& ranked) {
+        std::sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        std::unordered_set<std::string> seen;
+        std::vector<Ranked> out;
+        for (auto& r : ranked) {
+            if (out.size() == TOP_K) break;
+            if (seen.insert(r.second).second) out.push_back(std::move(r));
+        }
+        ranked.swap(out);
+    }
+
+    // A node and its slot in the parent's child map; its lists are counted
+    // separately.
+    static size_t node_bytes(const std::string& label) {
+        return sizeof(Node) + memory::heap_bytes(label) + memory::TREE_NODE_BYTES +
+               sizeof(std::pair<const char, std::unique_ptr<Node>>);
+    }
+
+    static size_t ranked_bytes(const std::vector<Ranked>& ranked) {
+        size_t n = ranked.size() * sizeof(Ranked);
+        for (const auto& r : ranked) n += memory::heap_bytes(r.second);
+        return n;
+    }
+
+    std::unique_ptr<Node> root_;
+    size_t bytes_;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+
+// On-demand sampling CPU profiler. While a profile runs, ITIMER_PROF raises
+// SIGPROF every 1/hz seconds of process CPU time, so the kernel interrupts
+// whichever thread is burning CPU and every worker is covered. The signal
+// handler only copies the interrupted stack into a preallocated slot; all
+// symbolization happens after the timer is disarmed. Nothing is installed
+// until the first profile, and no timer runs between profiles.
+//
+// Function names come from the dynamic symbol table, so link with -rdynamic
+// to get names for functions in the executable itself; otherwise frames show
+// as module+offset, which addr2line resolves.
+namespace profiler {
+
+class SamplingProfiler {
+public:
+    static const int MAX_DEPTH = 48;
+    static const size_t MAX_SAMPLES = 50000;
+
+    struct Result {
+        std::string folded; // "root;...;leaf count" per line
+        size_t samples = 0;
+        size_t dropped = 0;
+    };
+
+    static SamplingProfiler& instance() {
+        static SamplingProfiler* p = new SamplingProfiler; // the signal handler may outlive statics
+        return *p;
+    }
+
+    // Profiles the whole process for the given wall-clock duration and
+    // returns folded stacks. Returns false if a profile is already running.
+    bool run(std::chrono::milliseconds duration, int hz, Result& result) {
+        std::unique_lock<std::mutex> running(run_mutex_, std::try_to_lock);
+        if (!running.owns_lock()) return false;
+
+        std::unique_ptr<Sample[]> samples(new Sample[MAX_SAMPLES]);
+        install();
+        buffer_ = samples.get();
+        next_.store(0, std::memory_order_relaxed);
+        active_.store(true, std::memory_order_release);
+
+        long interval_us = std::max(1L, 1000000L / std::max(1, hz));
+        itimerval timer{};
+        timer.it_interval.tv_usec = interval_us % 1000000;
+        timer.it_interval.tv_sec = interval_us / 1000000;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+
+        std::this_thread::sleep_for(duration);
+
+        itimerval off{};
+        setitimer(ITIMER_PROF, &off, nullptr);
+        active_.store(false, std::memory_order_release);
+        // Pairs with the fence in on_signal(): without both, this store and
+        // the in_handler_ load below may be reordered, and a handler could
+        // still be writing a sample after the drain saw zero.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // A signal already delivered may still be writing its slot.
+        while (in_handler_.load(std::memory_order_acquire)) std::this_thread::yield();
+
+        size_t taken = next_.load(std::memory_order_relaxed);
+        result.samples = std::min(taken, MAX_SAMPLES);
+        result.dropped = taken - result.samples;
+        result.folded = fold(samples.get(), result.samples);
+        buffer_ = nullptr;
+        return true;
+    }
+
+private:
+    SamplingProfiler() = default;
+
+    struct Sample {
+        int depth;
+        void* frames[MAX_DEPTH];
+    };
+
+    void install() {
+        if (installed_) return;
+        // backtrace() loads the unwinder on first use; do that here, not in
+        // the signal handler.
+        void* warm[1];
+        backtrace(warm, 1);
+        struct sigaction action {};
+        action.sa_sigaction = &SamplingProfiler::on_signal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, nullptr);
+        installed_ = true;
+    }
+
+    static void on_signal(int, siginfo_t*, void*) {
+        SamplingProfiler& self = instance();
+        if (!self.active_.load(std::memory_order_acquire)) return;
+        int saved_errno = errno;
+        self.in_handler_.fetch_add(1, std::memory_order_acq_rel);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // see run()
+        if (self.active_.load(std::memory_order_acquire)) {
+            size_t slot = self.next_.fetch_add(1, std::memory_order_relaxed);
+            if (slot < MAX_SAMPLES) {
+                Sample& sample = self.buffer_[slot];
+                sample.depth = backtrace(sample.frames, MAX_DEPTH);
+            }
+        }
+        self.in_handler_.fetch_sub(1, std::memory_order_release);
+        errno = saved_errno;
+    }
+
+    static std::string symbol(void* address) {
+        Dl_info info;
+        if (!dladdr(address, &info)) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%p", address);
+            return buf;
+        }
+        std::string name;
+        if (info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            name = status == 0 ? demangled : info.dli_sname;
+            std::free(demangled);
+        } else {
+            const char* module = info.dli_fname ? std::strrchr(info.dli_fname, '/') : nullptr;
+            module = module ? module + 1 : (info.dli_fname ? info.dli_fname : "?");
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "+0x%zx", static_cast<size_t>(
+                static_cast<char*>(address) - static_cast<char*>(info.dli_fbase)));
+            name = std::string("[") + module + buf + "]";
+        }
+        // ';' separates frames and ' ' separates the count in folded output.
+        std::replace(name.begin(), name.end(), ';', ':');
+        std::replace(name.begin(), name.end(), '\n', ' ');
+        return name;
+    }
+
+    static std::string fold(const Sample* samples, size_t count) {
+        // Frame 0 is on_signal and frame 1 the signal trampoline. Return
+        // addresses point after the call, so look up address - 1.
+        const int skip = 2;
+        std::unordered_map<void*, std::string> names;
+        std::map<std::string, size_t> stacks;
+        for (size_t i = 0; i < count; i++) {
+            const Sample& s = samples[i];
+            std::string stack;
+            for (int f = s.depth - 1; f >= skip; f--) {
+                void* address = static_cast<char*>(s.frames[f]) - (f > skip ? 1 : 0);
+                auto it = names.find(address);
+                if (it == names.end()) it = names.emplace(address, symbol(address)).first;
+                if (!stack.empty()) stack += ';';
+                stack += it->second;
+            }
+            if (!stack.empty()) stacks[stack]++;
+        }
+        std::string out;
+        for (const auto& s : stacks) out += s.first + " " + std::to_string(s.second) + "\n";
+        return out;
+    }
+
+    std::mutex run_mutex_;
+    bool installed_ = false;
+    Sample* buffer_ = nullptr;
+    std::atomic<bool> active_{false};
+    std::atomic<int> in_handler_{0};
+    std::atomic<size_t> next_{0};
+};
+
+} // namespace profiler
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// Compressed bitmap in the style of Roaring: values are bucketed by their
+// high 16 bits, and each bucket is stored either as a sorted array of low
+// halves (sparse, up to ARRAY_MAX values) or as a 65536-bit bitmap (dense).
+// Set operations work bucket by bucket and never touch absent buckets.
+class RoaringBitmap {
+public:
+    void add(uint32_t value) {
+        Container& c = container(static_cast<uint16_t>(value >> 16));
+        uint16_t low = static_cast<uint16_t>(value);
+        if (c.is_bitmap()) {
+            uint64_t& word = c.bits[low >> 6];
+            uint64_t mask = uint64_t(1) << (low & 63);
+            if (!(word & mask)) {
+                word |= mask;
+                c.count++;
+            }
+            return;
+        }
+        auto it = std::lower_bound(c.array.begin(), c.array.end(), low);
+        if (it == c.array.end() || *it != low) {
+            c.array.insert(it, low);
+            c.count++;
+            c.normalize();
+        }
+    }
+
+    void remove(uint32_t value) {
+        auto it = find(static_cast<uint16_t>(value >> 16));
+        if (it == containers_.end()) {
+            return;
+        }
+        Container& c = it->second;
+        uint16_t low = static_cast<uint16_t>(value);
+        if (c.is_bitmap()) {
+            uint64_t& word = c.bits[low >> 6];
+            uint64_t mask = uint64_t(1) << (low & 63);
+            if (word & mask) {
+                word &= ~mask;
+                c.count--;
+            }
+        } else {
+            auto pos = std::lower_bound(c.array.begin(), c.array.end(), low);
+            if (pos != c.array.end() && *pos == low) {
+                c.array.erase(pos);
+                c.count--;
+            }
+        }
+        c.normalize();
+        if (c.count == 0) containers_.erase(it);
+    }
+
+    bool contains(uint32_t value) const {
+        auto it = std::lower_bound(containers_.begin(), containers_.end(), static_cast<uint16_t>(value >> 16),
+                                   [](const Bucket& b, uint16_t key) { return b.first < key; });
+        if (it == containers_.end() || it->first != static_cast<uint16_t>(value >> 16)) {
+            return false;
+        }
+        uint16_t low = static_cast<uint16_t>(value);
+        const Container& c = it->second;
+        if (c.is_bitmap()) return (c.bits[low >> 6] >> (low & 63)) & 1;
+        return std::binary_search(c.array.begin(), c.array.end(), low);
+    }
+
+    size_t cardinality() const {
+        size_t n = 0;
+        for (const auto& b : containers_) n += b.second.count;
+        return n;
+    }
+
+    bool empty() const { return containers_.empty(); }
+
+    // Heap bytes held by the containers.
+    size_t memory_bytes() const {
+        size_t n = containers_.size() * sizeof(Bucket);
+        for (const auto& b : containers_) n += b.second.array.size() * sizeof(uint16_t) + b.second.bits.size() * sizeof(uint64_t);
+        return n;
+    }
+
+    RoaringBitmap operator&(const RoaringBitmap& other) const { return combine(other, Op::And); }
+    RoaringBitmap operator|(const RoaringBitmap& other) const { return combine(other, Op::Or); }
+    RoaringBitmap operator-(const RoaringBitmap& other) const { return combine(other, Op::AndNot); }
+
+    // Calls fn(value) for every value in ascending order.
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const auto& b : containers_) {
+            uint32_t high = uint32_t(b.first) << 16;
+            const Container& c = b.second;
+            if (!c.is_bitmap()) {
+                for (uint16_t low : c.array) fn(high | low);
+                continue;
+            }
+            for (size_t w = 0; w < c.bits.size(); w++) {
+                for (uint64_t word = c.bits[w]; word; word &= word - 1) {
+                    fn(high | uint32_t(w * 64 + __builtin_ctzll(word)));
+                }
+            }
+        }
+    }
+
+private:
+    static const size_t ARRAY_MAX = 4096;
+    static const size_t WORDS = 65536 / 64;
+
+    enum class Op { And, Or, AndNot };
+
+    struct Container {
+        std::vector<uint16_t> array; // used while count <= ARRAY_MAX
+        std::vector<uint64_t> bits;  // WORDS words once denser than that
+        uint32_t count = 0;
+
+        bool is_bitmap() const { return !bits.empty(); }
+
+        // Switches representation when count crosses ARRAY_MAX.
+        void normalize() {
+            if (!is_bitmap() && count > ARRAY_MAX) {
+                bits.assign(WORDS, 0);
+                for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+                array.clear();
+                array.shrink_to_fit();
+            } else if (is_bitmap() && count <= ARRAY_MAX) {
+                array.clear();
+                for (size_t w = 0; w < WORDS; w++) {
+                    for (uint64_t word = bits[w]; word; word &= word - 1) {
+                        array.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+                    }
+                }
+                bits.clear();
+                bits.shrink_to_fit();
+            }
+        }
+
+        std::vector<uint64_t> as_bits() const {
+            if (is_bitmap()) return bits;
+            std::vector<uint64_t> out(WORDS, 0);
+            for (uint16_t low : array) out[low >> 6] |= uint64_t(1) << (low & 63);
+            return out;
+        }
+    };
+
+    using Bucket = std::pair<uint16_t, Container>;
+
+    std::vector<Bucket>::iterator find(uint16_t key) {
+        auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+                                   [](const Bucket& b, uint16_t k) { return b.first < k; });
+        return it != containers_.end() && it->first == key ? it : containers_.end();
+    }
+
+    Container& container(uint16_t key) {
+        auto it = std::lower_bound(containers_.begin(), containers_.end(), key,
+                                   [](const Bucket& b, uint16_t k) { return b.first < k; });
+        if (it == containers_.end() || it->first != key) {
+            it = containers_.insert(it, Bucket(key, Container()));
+        }
+        return it->second;
+    }
+
+    static Container apply(const Container& a, const Container& b, Op op) {
+        Container out;
+        if (!a.is_bitmap() && !b.is_bitmap()) {
+            auto into = std::back_inserter(out.array);
+            if (op == Op::And) std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), into);
+            if (op == Op::Or) std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), into);
+            if (op == Op::AndNot) std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), into);
+            out.count = static_cast<uint32_t>(out.array.size());
+        } else if (!a.is_bitmap() && op != Op::Or) {
+            // Sparse left side: probe the dense right side per value.
+            for (uint16_t low : a.array) {
+                bool in_b = (b.bits[low >> 6] >> (low & 63)) & 1;
+                if (in_b == (op == Op::And)) out.array.push_back(low);
+            }
+            out.count = static_cast<uint32_t>(out.array.size());
+        } else {
+            out.bits = a.as_bits();
+            std::vector<uint64_t> other = b.as_bits();
+            for (size_t w = 0; w < WORDS; w++) {
+                if (op == Op::And) out.bits[w] &= other[w];
+                if (op == Op::Or) out.bits[w] |= other[w];
+                if (op == Op::AndNot) out.bits[w] &= ~other[w];
+                out.count += __builtin_popcountll(out.bits[w]);
+            }
+        }
+        out.normalize();
+        return out;
+    }
+
+    RoaringBitmap combine(const RoaringBitmap& other, Op op) const {
+        RoaringBitmap out;
+        auto a = containers_.begin();
+        auto b = other.containers_.begin();
+        while (a != containers_.end() || b != other.containers_.end()) {
+            if (b == other.containers_.end() || (a != containers_.end() && a->first < b->first)) {
+                if (op != Op::And) out.containers_.push_back(*a);
+                ++a;
+            } else if (a == containers_.end() || b->first < a->first) {
+                if (op == Op::Or) out.containers_.push_back(*b);
+                ++b;
+            } else {
+                Container c = apply(a->second, b->second, op);
+                if (c.count) out.containers_.emplace_back(a->first, std::move(c));
+                ++a;
+                ++b;
+            }
+        }
+        return out;
+    }
+
+    std::vector<Bucket> containers_; // sorted by high 16 bits
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Self-contained scrypt (RFC 7914) over SHA-256, so password hashing needs no
+// library beyond the headers already vendored in include/.
+namespace scrypt {
+
+class Sha256 {
+public:
+    Sha256() { reset(); }
+
+    void reset() {
+        static const uint32_t INIT[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        std::memcpy(state_, INIT, sizeof(state_));
+        length_ = 0;
+        buffered_ = 0;
+    }
+
+    void update(const uint8_t* data, size_t len) {
+        length_ += len;
+        while (len > 0) {
+            size_t take = std::min(len, sizeof(buffer_) - buffered_);
+            std::memcpy(buffer_ + buffered_, data, take);
+            buffered_ += take;
+            data += take;
+            len -= take;
+            if (buffered_ == sizeof(buffer_)) {
+                compress(buffer_);
+                buffered_ = 0;
+            }
+        }
+    }
+
+    void finish(uint8_t out[32]) {
+        uint64_t bits = length_ * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        uint8_t zero = 0;
+        while (buffered_ != 56) {
+            update(&zero, 1);
+        }
+        uint8_t len_be[8];
+        for (int i = 0; i < 8; i++) {
+            len_be[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        }
+        update(len_be, 8);
+        for (int i = 0; i < 8; i++) {
+            out[4 * i] = static_cast<uint8_t>(state_[i] >> 24);
+            out[4 * i + 1] = static_cast<uint8_t>(state_[i] >> 16);
+            out[4 * i + 2] = static_cast<uint8_t>(state_[i] >> 8);
+            out[4 * i + 3] = static_cast<uint8_t>(state_[i]);
+        }
+    }
+
+private:
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const uint8_t block[64]) {
+        static const uint32_t K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+                   (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+        uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state_[0] += a; state_[1] += b; state_[2] += c; state_[3] += d;
+        state_[4] += e; state_[5] += f; state_[6] += g; state_[7] += h;
+    }
+
+    uint32_t state_[8];
+    uint64_t length_;
+    uint8_t buffer_[64];
+    size_t buffered_;
+};
+
+class HmacSha256 {
+public:
+    HmacSha256(const uint8_t* key, size_t key_len) {
+        uint8_t block[64] = {0};
+        if (key_len > 64) {
+            Sha256 h;
+            h.update(key, key_len);
+            h.finish(block);
+        } else {
+            std::memcpy(block, key, key_len);
+        }
+        uint8_t ipad[64];
+        for (int i = 0; i < 64; i++) {
+            ipad[i] = block[i] ^ 0x36;
+            opad_[i] = block[i] ^ 0x5c;
+        }
+        inner_.update(ipad, 64);
+    }
+
+    void update(const uint8_t* data, size_t len) { inner_.update(data, len); }
+
+    void finish(uint8_t out[32]) {
+        uint8_t inner_hash[32];
+        inner_.finish(inner_hash);
+        Sha256 outer;
+        outer.update(opad_, 64);
+        outer.update(inner_hash, 32);
+        outer.finish(out);
+    }
+
+private:
+    Sha256 inner_;
+    uint8_t opad_[64];
+};
+
+inline void pbkdf2_sha256(const uint8_t* password, size_t password_len, const uint8_t* salt, size_t salt_len,
+                          uint64_t iterations, uint8_t* out, size_t out_len) {
+    for (uint32_t block = 1; out_len > 0; block++) {
+        uint8_t counter[4] = {uint8_t(block >> 24), uint8_t(block >> 16), uint8_t(block >> 8), uint8_t(block)};
+        uint8_t u[32], t[32];
+        HmacSha256 mac(password, password_len);
+        mac.update(salt, salt_len);
+        mac.update(counter, 4);
+        mac.finish(u);
+        std::memcpy(t, u, 32);
+        for (uint64_t i = 1; i < iterations; i++) {
+            HmacSha256 next(password, password_len);
+            next.update(u, 32);
+            next.finish(u);
+            for (int k = 0; k < 32; k++) t[k] ^= u[k];
+        }
+        size_t take = std::min<size_t>(out_len, 32);
+        std::memcpy(out, t, take);
+        out += take;
+        out_len -= take;
+    }
+}
+
+inline uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+inline void salsa20_8(uint32_t b[16]) {
+    uint32_t x[16];
+    std::memcpy(x, b, sizeof(x));
+    for (int i = 0; i < 8; i += 2) {
+        x[4] ^= rotl(x[0] + x[12], 7);   x[8] ^= rotl(x[4] + x[0], 9);
+        x[12] ^= rotl(x[8] + x[4], 13);  x[0] ^= rotl(x[12] + x[8], 18);
+        x[9] ^= rotl(x[5] + x[1], 7);    x[13] ^= rotl(x[9] + x[5], 9);
+        x[1] ^= rotl(x[13] + x[9], 13);  x[5] ^= rotl(x[1] + x[13], 18);
+        x[14] ^= rotl(x[10] + x[6], 7);  x[2] ^= rotl(x[14] + x[10], 9);
+        x[6] ^= rotl(x[2] + x[14], 13);  x[10] ^= rotl(x[6] + x[2], 18);
+        x[3] ^= rotl(x[15] + x[11], 7);  x[7] ^= rotl(x[3] + x[15], 9);
+        x[11] ^= rotl(x[7] + x[3], 13);  x[15] ^= rotl(x[11] + x[7], 18);
+        x[1] ^= rotl(x[0] + x[3], 7);    x[2] ^= rotl(x[1] + x[0], 9);
+        x[3] ^= rotl(x[2] + x[1], 13);   x[0] ^= rotl(x[3] + x[2], 18);
+        x[6] ^= rotl(x[5] + x[4], 7);    x[7] ^= rotl(x[6] + x[5], 9);
+        x[4] ^= rotl(x[7] + x[6], 13);   x[5] ^= rotl(x[4] + x[7], 18);
+        x[11] ^= rotl(x[10] + x[9], 7);  x[8] ^= rotl(x[11] + x[10], 9);
+        x[9] ^= rotl(x[8] + x[11], 13);  x[10] ^= rotl(x[9] + x[8], 18);
+        x[12] ^= rotl(x[15] + x[14], 7); x[13] ^= rotl(x[12] + x[15], 9);
+        x[14] ^= rotl(x[13] + x[12], 13); x[15] ^= rotl(x[14] + x[13], 18);
+    }
+    for (int i = 0; i < 16; i++) b[i] += x[i];
+}
+
+// BlockMix over 2r 64-byte blocks held as 32-bit words; y is scratch of the same size.
+inline void block_mix(uint32_t* b, uint32_t* y, size_t r) {
+    uint32_t x[16];
+    std::memcpy(x, &b[(2 * r - 1) * 16], 64);
+    for (size_t i = 0; i < 2 * r; i++) {
+        for (int k = 0; k < 16; k++) x[k] ^= b[i * 16 + k];
+        salsa20_8(x);
+        std::memcpy(&y[i * 16], x, 64);
+    }
+    for (size_t i = 0; i < r; i++) {
+        std::memcpy(&b[i * 16], &y[(2 * i) * 16], 64);
+        std::memcpy(&b[(r + i) * 16], &y[(2 * i + 1) * 16], 64);
+    }
+}
+
+inline void ro_mix(uint8_t* block, size_t r, uint64_t n) {
+    size_t words = 32 * r;
+    std::vector<uint32_t> x(words), y(words), v(words * n);
+    for (size_t k = 0; k < words; k++) {
+        x[k] = uint32_t(block[4 * k]) | (uint32_t(block[4 * k + 1]) << 8) |
+               (uint32_t(block[4 * k + 2]) << 16) | (uint32_t(block[4 * k + 3]) << 24);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        std::memcpy(&v[i * words], x.data(), words * 4);
+        block_mix(x.data(), y.data(), r);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t j = x[(2 * r - 1) * 16] & (n - 1);
+        for (size_t k = 0; k < words; k++) x[k] ^= v[j * words + k];
+        block_mix(x.data(), y.data(), r);
+    }
+    for (size_t k = 0; k < words; k++) {
+        block[4 * k] = uint8_t(x[k]);
+        block[4 * k + 1] = uint8_t(x[k] >> 8);
+        block[4 * k + 2] = uint8_t(x[k] >> 16);
+        block[4 * k + 3] = uint8_t(x[k] >> 24);
+    }
+}
+
+// Derives out_len bytes; n must be a power of two greater than one.
+inline std::vector<uint8_t> derive(const std::string& password, const std::vector<uint8_t>& salt,
+                                   uint64_t n, uint32_t r, uint32_t p, size_t out_len) {
+    const uint8_t* pw = reinterpret_cast<const uint8_t*>(password.data());
+    std::vector<uint8_t> b(size_t(p) * 128 * r);
+    pbkdf2_sha256(pw, password.size(), salt.data(), salt.size(), 1, b.data(), b.size());
+    for (uint32_t i = 0; i < p; i++) {
+        ro_mix(&b[size_t(i) * 128 * r], r, n);
+    }
+    std::vector<uint8_t> out(out_len);
+    pbkdf2_sha256(pw, password.size(), b.data(), b.size(), 1, out.data(), out_len);
+    return out;
+}
+
+} // namespace scrypt
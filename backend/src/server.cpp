@@ -3,16 +3,49 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <sstream>
 #include <ctime>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <fstream> 
+#include <regex>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <future>
 
 
 #include "httplib.h"
 #include "json.hpp"
+#include "timer_wheel.h"
+#include "scrypt.h"
+#include "worker_pool.h"
+#include "event_log.h"
+#include "alias_table.h"
+#include "minhash.h"
+#include "simhash.h"
+#include "tfidf.h"
+#include "prefix_index.h"
+#include "roaring.h"
+#include "metrics.h"
+#include "logger.h"
+#include "trace.h"
+#include "profiler.h"
+#include "memory.h"
+#include "admission.h"
+#include "lanes.h"
 
 using json = nlohmann::json;
 
@@ -23,12 +56,81 @@ struct Flashcard {
     std::string back;
 };
 
+// Estimated heap footprint of one card, for g_memory.
+int64_t card_bytes(const Flashcard& card) {
+    return sizeof(Flashcard) + memory::heap_bytes(card.card_id) + memory::heap_bytes(card.front) + memory::heap_bytes(card.back);
+}
+
+// Card storage shared copy-on-write between a set and its clones. Reads go
+// through the const accessors; the mutators detach a private copy the first
+// time a set that still shares its storage is changed. The storage keeps
+// the cards' card_bytes() total current, so a clone is charged in O(1).
+class CardList {
+public:
+    CardList() : storage_(std::make_shared<Storage>()) {}
+    CardList(std::vector<Flashcard> cards) : storage_(std::make_shared<Storage>()) {
+        storage_->cards = std::move(cards);
+        for (const auto& card : storage_->cards) storage_->bytes += card_bytes(card);
+    }
+
+    const std::vector<Flashcard>& view() const { return storage_->cards; }
+
+    void push_back(Flashcard card) {
+        Storage& s = own();
+        s.bytes += card_bytes(card);
+        s.cards.push_back(std::move(card));
+    }
+
+    void set_text(size_t index, std::string front, std::string back) {
+        Storage& s = own();
+        Flashcard& card = s.cards[index];
+        s.bytes -= card_bytes(card);
+        card.front = std::move(front);
+        card.back = std::move(back);
+        s.bytes += card_bytes(card);
+    }
+
+    void erase(size_t index) {
+        Storage& s = own();
+        s.bytes -= card_bytes(s.cards[index]);
+        s.cards.erase(s.cards.begin() + index);
+    }
+
+    size_t size() const { return storage_->cards.size(); }
+    bool empty() const { return storage_->cards.empty(); }
+    const Flashcard& operator[](size_t i) const { return storage_->cards[i]; }
+    std::vector<Flashcard>::const_iterator begin() const { return storage_->cards.begin(); }
+    std::vector<Flashcard>::const_iterator end() const { return storage_->cards.end(); }
+
+    // Sum of card_bytes() over the cards.
+    int64_t bytes() const { return storage_->bytes; }
+
+    // Identifies the underlying storage so saveData() can write shared cards once.
+    const void* storage_id() const { return storage_.get(); }
+
+private:
+    struct Storage {
+        std::vector<Flashcard> cards;
+        int64_t bytes = 0;
+    };
+
+    Storage& own() {
+        if (storage_.use_count() > 1) {
+            storage_ = std::make_shared<Storage>(*storage_);
+        }
+        return *storage_;
+    }
+
+    std::shared_ptr<Storage> storage_;
+};
+
 struct FlashcardSet {
     std::string set_id;
     std::string user_id;
     std::string title;
     std::string description = ""; 
-    std::vector<Flashcard> cards;
+    CardList cards;
+    std::vector<std::string> tags; // normalised by parse_tags()
 };
 
 struct User {
@@ -38,10 +140,232 @@ struct User {
 };
 
 const std::string DATA_FILE = "data.json";
+const std::string SESSIONS_FILE = "sessions.json";
+
+// A session ends after this long without a request, or this long after login,
+// whichever comes first.
+const int64_t SESSION_IDLE_TTL_SECONDS = 24 * 60 * 60;
+const int64_t SESSION_ABSOLUTE_TTL_SECONDS = 30 * 24 * 60 * 60;
+// How stale a session's persisted last_seen may get before activity marks
+// the store dirty; the write itself waits for the once-a-second save.
+const int64_t SESSION_TOUCH_SAVE_SECONDS = 60;
 
 std::map<std::string, User> g_users;
 std::map<std::string, FlashcardSet> g_sets;
-std::map<std::string, std::string> g_sessions;
+
+// Guards g_users and g_sets (and g_tags). Route handlers take a shared lock
+// to read and a unique lock to mutate; streaming providers re-acquire it per
+// chunk.
+std::shared_mutex g_store_mutex;
+
+metrics::HistogramFamily g_request_latency("flipit_http_request_duration_seconds",
+                                           "Request latency by method, matched route and status.");
+metrics::HistogramFamily g_persistence_latency("flipit_persistence_duration_seconds",
+                                               "Time spent writing or reading persisted state, by operation.");
+std::atomic<int64_t> g_requests_in_flight{0};
+
+// Bounded, CoDel-shed queue of connections waiting for an httplib worker;
+// configured from FLIPIT_WORKERS and FLIPIT_ADMISSION_* in main().
+admission::Counters g_admission;
+metrics::HistogramFamily g_admission_delay("flipit_admission_queue_delay_seconds",
+                                           "Time admitted connections waited for a worker.");
+const int SHED_RETRY_AFTER_SECONDS = 1;
+
+// Answers with a 503 and closes the connection. httplib decides keep-alive
+// before routing, so a Connection: close header alone would leave the
+// socket open. Ending the body with a content provider that reports
+// failure makes httplib drop the connection once the response is written.
+void respond_busy_and_close(httplib::Response& res, const std::string& error) {
+    auto body = std::make_shared<std::string>("{\"error\": \"" + error + "\"}");
+    res.status = 503;
+    res.set_header("Retry-After", std::to_string(SHED_RETRY_AFTER_SECONDS));
+    res.set_header("Connection", "close");
+    res.set_content_provider(body->size(), "application/json",
+                             [body](size_t offset, size_t length, httplib::DataSink& sink) {
+                                 sink.write(body->data() + offset, length);
+                                 return false;
+                             });
+}
+
+// Run slots shared by the read, write and expensive lanes; configured from
+// FLIPIT_LANE_* in main().
+lanes::LaneScheduler g_lanes;
+metrics::HistogramFamily g_lane_wait("flipit_lane_wait_seconds", "Time requests waited for a run slot, by lane.");
+
+// Per-request phase spans, kept for sampled or slow requests and written to
+// a Chrome trace-event file; configured from FLIPIT_TRACE_* in main().
+tracing::Tracer g_tracer;
+
+void write_deferred_save();
+thread_local bool t_in_store_write = false;
+
+// Exclusive g_store_mutex for request handlers, traced as the wait for the
+// lock followed by the time it is held. A saveData() made while it is held
+// writes DATA_FILE only after the lock is released.
+class StoreWriteLock {
+public:
+    StoreWriteLock() : wait_("store_lock_wait"), lock_(g_store_mutex), held_((wait_.end(), "store_mutation")) {
+        t_in_store_write = true;
+    }
+
+    ~StoreWriteLock() {
+        held_.end();
+        lock_.unlock();
+        t_in_store_write = false;
+        write_deferred_save();
+    }
+
+private:
+    tracing::Span wait_;
+    std::unique_lock<std::shared_mutex> lock_;
+    tracing::Span held_;
+};
+
+// Estimated bytes held per subsystem, user and set, reported by
+// GET /admin/memory. Every structure below charges its own growth.
+memory::Ledger g_memory;
+
+// Runs fn on a per-user index and charges the change in its estimated size.
+template <typename Index, typename Fn>
+void charge_index(memory::Subsystem subsystem, const std::string& user_id, Index& index, Fn fn) {
+    int64_t before = static_cast<int64_t>(index.memory_bytes());
+    fn(index);
+    g_memory.charge(subsystem, user_id, "", static_cast<int64_t>(index.memory_bytes()) - before);
+}
+
+const size_t MAX_TAGS_PER_SET = 20;
+const size_t MAX_TAG_LENGTH = 64;
+
+// Tag filters as bitmap operations. Every set gets a dense ordinal (freed
+// ordinals are reused), and each user and each tag keeps a RoaringBitmap of
+// ordinals, so a filter is a few ANDs/ORs/ANDNOTs on bitmaps instead of a
+// scan over g_sets. Rebuilt from the sets at load; guarded by g_store_mutex.
+class TagIndex {
+public:
+    void set_added(const FlashcardSet& set) {
+        int64_t before = bitmap_bytes(set.user_id, set.tags);
+        uint32_t ordinal;
+        if (!free_.empty()) {
+            ordinal = free_.back();
+            free_.pop_back();
+            set_ids_[ordinal] = set.set_id;
+        } else {
+            ordinal = static_cast<uint32_t>(set_ids_.size());
+            set_ids_.push_back(set.set_id);
+        }
+        ordinals_[set.set_id] = ordinal;
+        users_[set.user_id].add(ordinal);
+        for (const auto& tag : set.tags) tags_[tag].add(ordinal);
+        g_memory.charge(memory::TAG_INDEX, set.user_id, "",
+                        ordinal_bytes(set.set_id) + bitmap_bytes(set.user_id, set.tags) - before);
+    }
+
+    void set_removed(const FlashcardSet& set) {
+        auto it = ordinals_.find(set.set_id);
+        if (it == ordinals_.end()) {
+            return;
+        }
+        int64_t before = bitmap_bytes(set.user_id, set.tags);
+        uint32_t ordinal = it->second;
+        remove_from(users_, set.user_id, ordinal);
+        for (const auto& tag : set.tags) remove_from(tags_, tag, ordinal);
+        set_ids_[ordinal].clear();
+        free_.push_back(ordinal);
+        ordinals_.erase(it);
+        g_memory.charge(memory::TAG_INDEX, set.user_id, "",
+                        bitmap_bytes(set.user_id, set.tags) - before - ordinal_bytes(set.set_id));
+    }
+
+    void tags_changed(const FlashcardSet& set, const std::vector<std::string>& old_tags) {
+        auto it = ordinals_.find(set.set_id);
+        if (it == ordinals_.end()) {
+            return;
+        }
+        std::set<std::string> touched(old_tags.begin(), old_tags.end());
+        touched.insert(set.tags.begin(), set.tags.end());
+        std::vector<std::string> keys(touched.begin(), touched.end());
+        int64_t before = bitmap_bytes("", keys);
+        for (const auto& tag : old_tags) remove_from(tags_, tag, it->second);
+        for (const auto& tag : set.tags) tags_[tag].add(it->second);
+        g_memory.charge(memory::TAG_INDEX, set.user_id, "", bitmap_bytes("", keys) - before);
+    }
+
+    // Set ids of the user's sets carrying every tag in all, at least one tag
+    // in any (when any is non-empty) and none of the tags in none.
+    std::vector<std::string> filter(const std::string& user_id, const std::vector<std::string>& all,
+                                    const std::vector<std::string>& any, const std::vector<std::string>& none) const {
+        std::vector<std::string> out;
+        RoaringBitmap result = lookup(users_, user_id);
+        for (const auto& tag : all) result = result & lookup(tags_, tag);
+        if (!any.empty()) {
+            RoaringBitmap either;
+            for (const auto& tag : any) either = either | lookup(tags_, tag);
+            result = result & either;
+        }
+        for (const auto& tag : none) result = result - lookup(tags_, tag);
+        result.for_each([&](uint32_t ordinal) { out.push_back(set_ids_[ordinal]); });
+        return out;
+    }
+
+private:
+    static RoaringBitmap lookup(const std::unordered_map<std::string, RoaringBitmap>& bitmaps, const std::string& key) {
+        auto it = bitmaps.find(key);
+        return it == bitmaps.end() ? RoaringBitmap() : it->second;
+    }
+
+    // A set's ordinals_ entry and its set_ids_ slot.
+    static int64_t ordinal_bytes(const std::string& set_id) {
+        return memory::HASH_NODE_BYTES + memory::string_bytes(set_id) + sizeof(uint32_t) + memory::string_bytes(set_id);
+    }
+
+    // Bytes held by the user's bitmap and the given tags' bitmaps.
+    int64_t bitmap_bytes(const std::string& user_id, const std::vector<std::string>& tags) const {
+        auto bytes = [](const std::unordered_map<std::string, RoaringBitmap>& bitmaps, const std::string& key) -> int64_t {
+            auto it = bitmaps.find(key);
+            return it == bitmaps.end() ? 0 : memory::HASH_NODE_BYTES + memory::string_bytes(key) + sizeof(RoaringBitmap) + it->second.memory_bytes();
+        };
+        int64_t n = user_id.empty() ? 0 : bytes(users_, user_id);
+        for (const auto& tag : tags) n += bytes(tags_, tag);
+        return n;
+    }
+
+    static void remove_from(std::unordered_map<std::string, RoaringBitmap>& bitmaps, const std::string& key, uint32_t ordinal) {
+        auto it = bitmaps.find(key);
+        if (it == bitmaps.end()) return;
+        it->second.remove(ordinal);
+        if (it->second.empty()) bitmaps.erase(it);
+    }
+
+    std::unordered_map<std::string, uint32_t> ordinals_;
+    std::vector<std::string> set_ids_; // by ordinal; empty when free
+    std::vector<uint32_t> free_;
+    std::unordered_map<std::string, RoaringBitmap> users_;
+    std::unordered_map<std::string, RoaringBitmap> tags_;
+};
+
+TagIndex g_tags;
+
+// Trims and lowercases each tag, drops duplicates and sorts. Returns false
+// if the value is not a list of strings or breaks the size limits.
+bool parse_tags(const json& value, std::vector<std::string>& tags) {
+    if (!value.is_array() || value.size() > MAX_TAGS_PER_SET) {
+        return false;
+    }
+    std::set<std::string> unique;
+    for (const auto& item : value) {
+        if (!item.is_string()) return false;
+        std::string raw = item.get<std::string>();
+        size_t begin = raw.find_first_not_of(" \t\r\n");
+        size_t end = raw.find_last_not_of(" \t\r\n");
+        if (begin == std::string::npos) return false;
+        std::string tag = raw.substr(begin, end - begin + 1);
+        if (tag.size() > MAX_TAG_LENGTH) return false;
+        for (auto& c : tag) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        unique.insert(tag);
+    }
+    tags.assign(unique.begin(), unique.end());
+    return true;
+}
 
 void to_json(json& j, const Flashcard& p) {
     j = json{{"card_id", p.card_id}, {"front", p.front}, {"back", p.back}};
@@ -53,13 +377,22 @@ void from_json(const json& j, Flashcard& p) {
     p.back = j.at("back");
 }
 
+void to_json(json& j, const CardList& p) {
+    j = p.view();
+}
+
+void from_json(const json& j, CardList& p) {
+    p = CardList(j.get<std::vector<Flashcard>>());
+}
+
 void to_json(json& j, const FlashcardSet& p) {
     j = json{
         {"set_id", p.set_id}, 
         {"user_id", p.user_id}, 
         {"title", p.title}, 
         {"description", p.description}, 
-        {"cards", p.cards}
+        {"cards", p.cards},
+        {"tags", p.tags}
     };
 }
 
@@ -75,10 +408,12 @@ void from_json(const json& j, FlashcardSet& p) {
     }
     
     if (j.contains("cards")) {
-        p.cards = j.at("cards").get<std::vector<Flashcard>>();
+        p.cards = j.at("cards").get<CardList>();
     } else {
         p.cards = {};
     }
+
+    p.tags = j.contains("tags") ? j.at("tags").get<std::vector<std::string>>() : std::vector<std::string>{};
 }
 
 void to_json(json& j, const User& p) {
@@ -91,24 +426,1059 @@ void from_json(const json& j, User& p) {
     p.password_hash = j.at("password_hash");
 }
 
+// Estimated footprints of g_users and g_sets entries for g_memory. Sets are
+// charged their cards in full even while a clone shares the storage, so
+// the figures are logical sizes per tenant rather than resident bytes.
+int64_t user_bytes(const User& user) {
+    return memory::TREE_NODE_BYTES + memory::string_bytes(user.user_id) + sizeof(User) +
+           memory::heap_bytes(user.user_id) + memory::heap_bytes(user.username) + memory::heap_bytes(user.password_hash);
+}
 
-void saveData() {
-    json j;
+int64_t set_header_bytes(const FlashcardSet& set) {
+    int64_t n = memory::TREE_NODE_BYTES + memory::string_bytes(set.set_id) + sizeof(FlashcardSet) +
+                memory::heap_bytes(set.set_id) + memory::heap_bytes(set.user_id) + memory::heap_bytes(set.title) +
+                memory::heap_bytes(set.description) + 2 * sizeof(long) + sizeof(std::vector<Flashcard>);
+    for (const auto& tag : set.tags) n += memory::string_bytes(tag);
+    return n;
+}
+
+// Charges (sign 1) or releases (sign -1) a whole set.
+void charge_set(const FlashcardSet& set, int sign) {
+    g_memory.charge(memory::SETS, set.user_id, set.set_id, sign * set_header_bytes(set));
+    g_memory.charge(memory::CARDS, set.user_id, set.set_id, sign * set.cards.bytes());
+}
+
+
+// Packed quiz counters and SM-2 review state for one card as seen by one user.
+struct CardStat {
+    uint32_t attempts = 0;
+    uint32_t correct = 0;
+    uint32_t last_seen = 0; // unix seconds of the latest answer
+    uint32_t streak = 0;    // consecutive correct answers, reset by a miss
+    uint32_t due = 0;       // unix seconds when the card is next due for review
+    uint32_t interval = 0;  // current review interval in days
+    uint16_t ease = 2500;   // SM-2 ease factor x1000
+    uint16_t lapses = 0;    // misses after the card had been learned
+};
+
+static_assert(sizeof(CardStat) == 28, "CardStat is meant to stay a fixed 28-byte record");
+
+struct QuizResult {
+    std::string card_id;
+    bool correct = false;
+    int grade = -1; // SM-2 quality 0-5; derived from correct when absent
+    uint32_t latency_ms = 0;
+};
+
+// Dashboard aggregates for one set, kept current by card mutations and quiz
+// results so listing sets never reads cards or per-card counters.
+struct SetSummary {
+    uint32_t card_count = 0;
+    uint32_t mastered = 0;      // cards whose streak has reached MASTERY_STREAK
+    uint32_t last_studied = 0;  // unix seconds of the latest answer in the set
+    // Answered cards per due day (unix days); past days fold into one bucket.
+    std::map<uint32_t, uint32_t> due_by_day;
+};
+
+const uint32_t MASTERY_STREAK = 3;
+const uint32_t SECONDS_PER_DAY = 24 * 60 * 60;
+
+const uint16_t SM2_MIN_EASE = 1300;
+const uint32_t SM2_RELEARN_DELAY_SECONDS = 10 * 60;
+
+// Applies one graded answer to a card's SM-2 state.
+void sm2_update(CardStat& stat, int grade, uint32_t now) {
+    if (grade >= 3) {
+        if (stat.streak <= 1) {
+            stat.interval = stat.streak == 0 ? 1 : 6;
+        } else {
+            stat.interval = static_cast<uint32_t>(stat.interval * (stat.ease / 1000.0) + 0.5);
+        }
+        stat.due = now + stat.interval * 24 * 60 * 60;
+    } else {
+        if (stat.interval > 1) stat.lapses++;
+        stat.interval = 0;
+        stat.due = now + SM2_RELEARN_DELAY_SECONDS;
+    }
+
+    int q = 5 - grade;
+    int ease = stat.ease + 100 - q * (80 + q * 20);
+    stat.ease = static_cast<uint16_t>(std::max<int>(ease, SM2_MIN_EASE));
+}
+
+// Per-user card counters keyed by "set_id/card_id". Sharded by user and kept
+// outside g_store_mutex, so recording answers never waits on set edits and
+// concurrent quiz sessions only contend within one shard.
+//
+// Each user also has a due queue ordered by CardStat::due over every card
+// they have answered, so the next N reviews cost O(log n + N) rather than a
+// walk over all of their sets. Cards enter the queue on their first answer.
+class StatsStore {
+public:
+    static const size_t SHARDS = 64;
+
+    struct DueCard {
+        std::string set_id;
+        std::string card_id;
+        CardStat stat;
+    };
+
+    static std::string card_key(const std::string& set_id, const std::string& card_id) {
+        return set_id + "/" + card_id;
+    }
+
+    void record(const std::string& user_id, const std::string& set_id, const std::vector<QuizResult>& results, uint32_t now) {
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        UserStats& stats = shard.users[user_id];
+        auto summary = stats.sets.find(set_id);
+        for (const auto& result : results) {
+            auto slot = stats.cards.emplace(card_key(set_id, result.card_id), CardStat());
+            const std::string* key = &slot.first->first;
+            CardStat& stat = slot.first->second;
+            if (slot.second) {
+                g_memory.charge(memory::STATS, user_id, set_id, stat_bytes(*key));
+            } else {
+                stats.due_queue.erase({stat.due, key});
+                if (summary != stats.sets.end()) summary_remove(summary->second, stat);
+            }
+
+            int grade = result.grade >= 0 ? std::min(result.grade, 5) : (result.correct ? 4 : 1);
+            sm2_update(stat, grade, now);
+
+            stat.attempts++;
+            stat.last_seen = now;
+            if (result.correct) {
+                stat.correct++;
+                stat.streak++;
+            } else {
+                stat.streak = 0;
+            }
+            stats.due_queue.insert({stat.due, key});
+            if (summary != stats.sets.end()) summary_add(summary->second, stat);
+        }
+        dirty = true;
+    }
+
+    void set_added(const std::string& user_id, const std::string& set_id, uint32_t card_count) {
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        summary_for(shard.users[user_id], user_id, set_id).card_count = card_count;
+    }
+
+    void card_added(const std::string& user_id, const std::string& set_id) {
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        summary_for(shard.users[user_id], user_id, set_id).card_count++;
+    }
+
+    // Summaries of every set the user owns, ordered by set id.
+    std::map<std::string, SetSummary> summaries(const std::string& user_id, uint32_t now) {
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto user = shard.users.find(user_id);
+        if (user == shard.users.end()) {
+            return {};
+        }
+        for (auto& summary : user->second.sets) {
+            fold_overdue(summary.second, now / SECONDS_PER_DAY);
+        }
+        return user->second.sets;
+    }
+
+    // Counters for the given cards; cards never answered come back zeroed.
+    std::vector<CardStat> lookup(const std::string& user_id, const std::string& set_id, const std::vector<std::string>& card_ids) {
+        std::vector<CardStat> out(card_ids.size());
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto user = shard.users.find(user_id);
+        if (user == shard.users.end()) {
+            return out;
+        }
+        for (size_t i = 0; i < card_ids.size(); i++) {
+            auto it = user->second.cards.find(card_key(set_id, card_ids[i]));
+            if (it != user->second.cards.end()) out[i] = it->second;
+        }
+        return out;
+    }
+
+    // Up to limit cards due at or before now, most overdue first.
+    std::vector<DueCard> due(const std::string& user_id, uint32_t now, size_t limit) {
+        std::vector<DueCard> out;
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto user = shard.users.find(user_id);
+        if (user == shard.users.end()) {
+            return out;
+        }
+        for (const auto& entry : user->second.due_queue) {
+            if (entry.first > now || out.size() >= limit) break;
+            const std::string& key = *entry.second;
+            size_t slash = key.find('/');
+            out.push_back({key.substr(0, slash), key.substr(slash + 1), user->second.cards.at(key)});
+        }
+        return out;
+    }
+
+    void card_removed(const std::string& user_id, const std::string& set_id, const std::string& card_id) {
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto user = shard.users.find(user_id);
+        if (user == shard.users.end()) {
+            return;
+        }
+        auto summary = user->second.sets.find(set_id);
+        if (summary != user->second.sets.end() && summary->second.card_count > 0) {
+            summary->second.card_count--;
+        }
+        auto it = user->second.cards.find(card_key(set_id, card_id));
+        if (it != user->second.cards.end()) {
+            if (summary != user->second.sets.end()) summary_remove(summary->second, it->second);
+            user->second.due_queue.erase({it->second.due, &it->first});
+            g_memory.charge(memory::STATS, user_id, set_id, -stat_bytes(it->first));
+            user->second.cards.erase(it);
+            dirty = true;
+        }
+    }
+
+    void set_removed(const std::string& user_id, const std::string& set_id) {
+        Shard& shard = shard_for(user_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto user = shard.users.find(user_id);
+        if (user == shard.users.end()) {
+            return;
+        }
+        if (user->second.sets.erase(set_id)) {
+            g_memory.charge(memory::STATS, user_id, set_id, -summary_bytes(set_id));
+        }
+        std::string prefix = set_id + "/";
+        auto& cards = user->second.cards;
+        for (auto it = cards.begin(); it != cards.end();) {
+            if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                user->second.due_queue.erase({it->second.due, &it->first});
+                g_memory.charge(memory::STATS, user_id, set_id, -stat_bytes(it->first));
+                it = cards.erase(it);
+                dirty = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Stored as {user_id: {"set_id/card_id": [attempts, correct, last_seen,
+    // streak, due, interval, ease, lapses]}}.
+    json to_json() {
+        json j = json::object();
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (const auto& user : shard.users) {
+                json cards = json::object();
+                for (const auto& card : user.second.cards) {
+                    const CardStat& c = card.second;
+                    cards[card.first] = json::array({c.attempts, c.correct, c.last_seen, c.streak,
+                                                     c.due, c.interval, c.ease, c.lapses});
+                }
+                j[user.first] = cards;
+            }
+        }
+        return j;
+    }
+
+    // Restores counters and rebuilds every user's due queue and set
+    // summaries; call after set_added() has registered the loaded sets.
+    // Records saved before scheduling existed are due at their last answer.
+    void from_json(const json& j) {
+        for (const auto& user : j.items()) {
+            Shard& shard = shard_for(user.key());
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            UserStats& stats = shard.users[user.key()];
+            std::vector<std::pair<uint32_t, const std::string*>> queue;
+            for (const auto& card : user.value().items()) {
+                const json& v = card.value();
+                auto slot = stats.cards.emplace(card.key(), CardStat());
+                if (slot.second) {
+                    g_memory.charge(memory::STATS, user.key(), card.key().substr(0, card.key().find('/')), stat_bytes(card.key()));
+                }
+                CardStat& c = slot.first->second;
+                c.attempts = v.at(0);
+                c.correct = v.at(1);
+                c.last_seen = v.at(2);
+                c.streak = v.at(3);
+                if (v.size() >= 8) {
+                    c.due = v.at(4);
+                    c.interval = v.at(5);
+                    c.ease = v.at(6);
+                    c.lapses = v.at(7);
+                } else {
+                    c.due = c.last_seen;
+                }
+                queue.emplace_back(c.due, &slot.first->first);
+            }
+            std::sort(queue.begin(), queue.end());
+            stats.due_queue.insert(queue.begin(), queue.end());
+
+            for (const auto& entry : queue) {
+                const std::string& key = *entry.second;
+                auto summary = stats.sets.find(key.substr(0, key.find('/')));
+                if (summary != stats.sets.end()) summary_add(summary->second, stats.cards.at(key));
+            }
+        }
+    }
+
+    // Set by every change; the maintenance thread persists and clears it.
+    std::atomic<bool> dirty{false};
+
+private:
+    static void summary_add(SetSummary& summary, const CardStat& stat) {
+        if (stat.streak >= MASTERY_STREAK) summary.mastered++;
+        summary.last_studied = std::max(summary.last_studied, stat.last_seen);
+        summary.due_by_day[stat.due / SECONDS_PER_DAY]++;
+    }
+
+    static void summary_remove(SetSummary& summary, const CardStat& stat) {
+        if (stat.streak >= MASTERY_STREAK && summary.mastered > 0) summary.mastered--;
+        // Overdue days may already have been folded into the earliest bucket.
+        auto bucket = summary.due_by_day.find(stat.due / SECONDS_PER_DAY);
+        if (bucket == summary.due_by_day.end()) bucket = summary.due_by_day.begin();
+        if (bucket != summary.due_by_day.end() && --bucket->second == 0) {
+            summary.due_by_day.erase(bucket);
+        }
+    }
+
+    // Merges every bucket up to today into one, keeping the map to roughly
+    // one entry per future due day.
+    static void fold_overdue(SetSummary& summary, uint32_t today) {
+        auto& days = summary.due_by_day;
+        auto end = days.upper_bound(today);
+        if (days.begin() == end || std::next(days.begin()) == end) {
+            return;
+        }
+        uint32_t total = 0;
+        uint32_t first_day = days.begin()->first;
+        for (auto it = days.begin(); it != end; ++it) total += it->second;
+        days.erase(days.begin(), end);
+        days[first_day] = total;
+    }
+
+    // A counter in cards plus its due_queue entry.
+    static int64_t stat_bytes(const std::string& key) {
+        return memory::HASH_NODE_BYTES + memory::string_bytes(key) + sizeof(CardStat) +
+               memory::TREE_NODE_BYTES + sizeof(std::pair<uint32_t, const std::string*>);
+    }
+
+    // A set's summary, not counting its due_by_day buckets.
+    static int64_t summary_bytes(const std::string& set_id) {
+        return memory::TREE_NODE_BYTES + memory::string_bytes(set_id) + sizeof(SetSummary);
+    }
+
+    struct UserStats {
+        std::map<std::string, SetSummary> sets;
+        std::unordered_map<std::string, CardStat> cards;
+        // (due, key in cards); keys are stable because unordered_map never
+        // moves its nodes.
+        std::set<std::pair<uint32_t, const std::string*>> due_queue;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, UserStats> users;
+    };
+
+    Shard& shard_for(const std::string& user_id) {
+        return shards_[std::hash<std::string>()(user_id) % SHARDS];
+    }
+
+    static SetSummary& summary_for(UserStats& stats, const std::string& user_id, const std::string& set_id) {
+        auto slot = stats.sets.emplace(set_id, SetSummary());
+        if (slot.second) g_memory.charge(memory::STATS, user_id, set_id, summary_bytes(set_id));
+        return slot.first->second;
+    }
+
+    Shard shards_[SHARDS];
+};
+
+StatsStore g_stats;
+
+// Every quiz answer, for progress history; flushed by maintenance_loop().
+eventlog::EventLog g_events;
+
+const size_t MAX_QUIZ_RESULTS_PER_REQUEST = 1000;
+const size_t DEFAULT_REVIEW_LIMIT = 20;
+const size_t MAX_REVIEW_LIMIT = 500;
+
+// Quiz sampling weight is 1 + QUIZ_ERROR_WEIGHT * smoothed error rate
+// + QUIZ_RECENCY_WEIGHT * (days since last answer / horizon, capped at 1).
+const double QUIZ_ERROR_WEIGHT = 4.0;
+const double QUIZ_RECENCY_WEIGHT = 2.0;
+const double QUIZ_RECENCY_HORIZON_DAYS = 7.0;
+const size_t DEFAULT_QUIZ_SIZE = 20;
+const size_t MAX_QUIZ_SIZE = 500;
+
+double quiz_card_weight(const CardStat& stat, uint32_t day_start) {
+    double error_rate = (stat.attempts - stat.correct + 1.0) / (stat.attempts + 2.0);
+    double days_since = stat.last_seen ? (double(day_start) - double(stat.last_seen)) / SECONDS_PER_DAY : QUIZ_RECENCY_HORIZON_DAYS;
+    double recency = std::min(std::max(days_since, 0.0) / QUIZ_RECENCY_HORIZON_DAYS, 1.0);
+    return 1.0 + QUIZ_ERROR_WEIGHT * error_rate + QUIZ_RECENCY_WEIGHT * recency;
+}
+
+// Alias table over one set's cards. Entries index into the set's card vector,
+// which is safe because adding or deleting a card invalidates the sampler.
+struct QuizSampler {
+    uint32_t day = 0; // recency is measured in whole days from this day
+    std::vector<double> weights;
+    AliasTable table;
+};
+
+// Samplers are built on demand and dropped whenever a set's weights change:
+// new quiz results, added or deleted cards, or a new day for recency.
+class QuizSamplerCache {
+public:
+    std::shared_ptr<const QuizSampler> get(const std::string& set_id, uint32_t day) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = samplers_.find(set_id);
+        if (it == samplers_.end() || it->second->day != day) {
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    // Read before building a sampler and pass to put(), so a sampler built
+    // from weights that were invalidated meanwhile is not cached.
+    uint64_t generation() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return generation_;
+    }
+
+    void put(const std::string& set_id, std::shared_ptr<const QuizSampler> sampler, uint64_t generation) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (generation == generation_) {
+            auto& slot = samplers_[set_id];
+            g_memory.charge(memory::QUIZ_SAMPLER_CACHE, "", set_id,
+                            entry_bytes(set_id, sampler.get()) - entry_bytes(set_id, slot.get()));
+            slot = std::move(sampler);
+        }
+    }
+
+    void invalidate(const std::string& set_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+        auto it = samplers_.find(set_id);
+        if (it != samplers_.end()) {
+            g_memory.charge(memory::QUIZ_SAMPLER_CACHE, "", set_id, -entry_bytes(set_id, it->second.get()));
+            samplers_.erase(it);
+        }
+    }
+
+private:
+    // A cached sampler: map entry, shared_ptr control block, weights and the
+    // alias table's probability and alias columns.
+    static int64_t entry_bytes(const std::string& set_id, const QuizSampler* sampler) {
+        if (!sampler) return 0;
+        return memory::HASH_NODE_BYTES + memory::string_bytes(set_id) + sizeof(std::shared_ptr<const QuizSampler>) +
+               2 * sizeof(long) + sizeof(QuizSampler) + sampler->weights.size() * (sizeof(double) + sizeof(double) + sizeof(uint32_t));
+    }
+
+    std::mutex mutex_;
+    uint64_t generation_ = 0;
+    std::unordered_map<std::string, std::shared_ptr<const QuizSampler>> samplers_;
+};
+
+QuizSamplerCache g_quiz_samplers;
+
+const size_t DEFAULT_CHOICE_COUNT = 3;
+const size_t MAX_CHOICE_COUNT = 10;
+
+// Per-user MinHash index over card backs, used to pick multiple-choice
+// distractors. A user's index is built on their first choices request and
+// then kept in step with card edits; set deletion and cloning just drop it
+// so those stay O(1), and it is rebuilt on the next request.
+class DistractorIndex {
+public:
+    void card_upserted(const std::string& user_id, const std::string& set_id, const Flashcard& card) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it != users_.end()) {
+            charge_index(memory::DISTRACTOR_INDEX, user_id, it->second, [&](MinHashIndex& index) {
+                index.upsert(StatsStore::card_key(set_id, card.card_id), set_id, card.back);
+            });
+        }
+    }
+
+    void card_removed(const std::string& user_id, const std::string& set_id, const std::string& card_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it != users_.end()) {
+            charge_index(memory::DISTRACTOR_INDEX, user_id, it->second, [&](MinHashIndex& index) {
+                index.remove(StatsStore::card_key(set_id, card_id));
+            });
+        }
+    }
+
+    void reset(const std::string& user_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) return;
+        g_memory.charge(memory::DISTRACTOR_INDEX, user_id, "", -static_cast<int64_t>(it->second.memory_bytes()));
+        users_.erase(it);
+    }
+
+    // Up to count other cards whose backs resemble the given card's back,
+    // preferring cards from the same set and topping up with random cards
+    // when LSH finds too few. Callers hold g_store_mutex.
+    std::vector<MinHashIndex::Entry> choices(const std::string& user_id, const std::string& set_id,
+                                             const std::string& card_id, size_t count, int64_t now) {
+        thread_local std::mt19937_64 rng(std::random_device{}());
+        std::vector<MinHashIndex::Entry> picked;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) {
+            it = users_.emplace(user_id, build(user_id, now)).first;
+            g_memory.charge(memory::DISTRACTOR_INDEX, user_id, "", it->second.memory_bytes());
+        }
+        const MinHashIndex& index = it->second;
+        std::string key = StatsStore::card_key(set_id, card_id);
+        const MinHashIndex::Entry* target = index.find(key);
+        if (!target) {
+            return picked;
+        }
+
+        // Distinct answers only, and never one that reads the same as the correct one.
+        std::unordered_set<std::string> texts = {normalize(target->text)};
+        auto take = [&](const MinHashIndex::Entry* e) {
+            if (picked.size() < count && e->key != key && texts.insert(normalize(e->text)).second) {
+                picked.push_back(*e);
+            }
+        };
+        std::vector<MinHashIndex::Match> matches = index.similar(key);
+        for (const auto& m : matches) {
+            if (m.entry->group == set_id) take(m.entry);
+        }
+        for (const auto& m : matches) take(m.entry);
+        for (size_t tries = 0; picked.size() < count && tries < 8 * count; tries++) {
+            take(index.random_entry(rng));
+        }
+        return picked;
+    }
+
+private:
+    static std::string normalize(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (!std::isspace(static_cast<unsigned char>(c))) out += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return out;
+    }
+
+    static MinHashIndex build(const std::string& user_id, int64_t now) {
+        MinHashIndex index;
+        for (const auto& summary : g_stats.summaries(user_id, static_cast<uint32_t>(now))) {
+            auto set = g_sets.find(summary.first);
+            if (set == g_sets.end()) continue;
+            for (const auto& card : set->second.cards) {
+                index.upsert(StatsStore::card_key(set->first, card.card_id), set->first, card.back);
+            }
+        }
+        return index;
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, MinHashIndex> users_;
+};
+
+DistractorIndex g_distractors;
+
+const int DEFAULT_DUPLICATE_DISTANCE = 6;
+const size_t DEFAULT_DUPLICATE_LIMIT = 100;
+const size_t MAX_DUPLICATE_LIMIT = 1000;
+
+struct CardDuplicate {
+    std::string a_key;
+    std::string b_key;
+    int distance;
+};
+
+// Per-user SimHash fingerprints of card front/back text for near-duplicate
+// detection. The first request for a user copies their cards and queues a
+// build, which run() performs on a background thread without the store lock:
+// fingerprints and pair probes are split across cores and the finished index
+// is published whole. Card changes that arrive meanwhile are queued and
+// replayed on publish; after that the index is kept up to date per card and
+// tracks near-duplicate pairs as cards change, so a query only reads them.
+class DuplicateIndex {
+public:
+    void card_upserted(const std::string& user_id, const std::string& set_id, const Flashcard& card) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string key = StatsStore::card_key(set_id, card.card_id);
+        uint64_t fingerprint = SimHashIndex::fingerprint({card.front, card.back});
+        auto it = users_.find(user_id);
+        if (it != users_.end()) {
+            charge_index(memory::DUPLICATE_INDEX, user_id, it->second, [&](SimHashIndex& index) {
+                index.upsert(key, set_id, fingerprint);
+            });
+        } else if (building_.count(user_id)) {
+            building_[user_id].changes.push_back({false, key, set_id, fingerprint});
+        }
+    }
+
+    void card_removed(const std::string& user_id, const std::string& set_id, const std::string& card_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string key = StatsStore::card_key(set_id, card_id);
+        auto it = users_.find(user_id);
+        if (it != users_.end()) {
+            charge_index(memory::DUPLICATE_INDEX, user_id, it->second, [&](SimHashIndex& index) {
+                index.remove(key);
+            });
+        } else if (building_.count(user_id)) {
+            building_[user_id].changes.push_back({true, key, set_id, 0});
+        }
+    }
+
+    // Drops the user's index, and any build in flight, which would otherwise
+    // publish the old library.
+    void reset(const std::string& user_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        building_.erase(user_id);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) return;
+        g_memory.charge(memory::DUPLICATE_INDEX, user_id, "", -static_cast<int64_t>(it->second.memory_bytes()));
+        users_.erase(it);
+    }
+
+    // Near-duplicate pairs across the user's library, closest first. With a
+    // set_id, only pairs with at least one card in that set (listed first).
+    // Returns false while the user's index is still being built, queueing
+    // the build if it has not started. Callers hold g_store_mutex.
+    bool find(const std::string& user_id, const std::string& set_id, int max_distance, size_t limit, int64_t now,
+              std::vector<CardDuplicate>& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) {
+            if (!building_.count(user_id)) enqueue(user_id, now);
+            return false;
+        }
+        auto pairs = it->second.pairs(max_distance, limit, [&set_id](const SimHashIndex::Entry& e) {
+            return set_id.empty() || e.group == set_id;
+        });
+        for (const auto& pair : pairs) {
+            out.push_back({pair.a->key, pair.b->key, pair.distance});
+        }
+        return true;
+    }
+
+    // The build thread: takes queued libraries one at a time.
+    void run() {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this] { return !queue_.empty(); });
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            SimHashIndex::parallel_for(job.entries.size(), threads, [&job](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    auto& e = job.entries[i];
+                    e.fingerprint = SimHashIndex::fingerprint({job.texts[i].first, job.texts[i].second});
+                }
+            });
+            job.texts.clear();
+            SimHashIndex index = SimHashIndex::build(std::move(job.entries), threads);
+            publish(job, std::move(index));
+        }
+    }
+
+private:
+    struct Change {
+        bool removed;
+        std::string key;
+        std::string group;
+        uint64_t fingerprint;
+    };
+
+    struct Build {
+        uint64_t id = 0;
+        std::vector<Change> changes; // made after the cards were copied
+    };
+
+    struct Job {
+        std::string user_id;
+        uint64_t id = 0;
+        std::vector<SimHashIndex::Entry> entries;                // fingerprints filled in by run()
+        std::vector<std::pair<std::string, std::string>> texts; // front/back per entry
+    };
+
+    // Copies the user's cards for run(). Callers hold mutex_ and g_store_mutex.
+    void enqueue(const std::string& user_id, int64_t now) {
+        Job job;
+        job.user_id = user_id;
+        job.id = ++next_build_;
+        for (const auto& summary : g_stats.summaries(user_id, static_cast<uint32_t>(now))) {
+            auto set = g_sets.find(summary.first);
+            if (set == g_sets.end()) continue;
+            for (const auto& card : set->second.cards) {
+                job.entries.push_back({StatsStore::card_key(set->first, card.card_id), set->first, 0, {}});
+                job.texts.emplace_back(card.front, card.back);
+            }
+        }
+        building_[user_id].id = job.id;
+        queue_.push_back(std::move(job));
+        ready_.notify_one();
+    }
+
+    void publish(const Job& job, SimHashIndex index) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto build = building_.find(job.user_id);
+        if (build == building_.end() || build->second.id != job.id) return; // reset while building
+        for (const auto& change : build->second.changes) {
+            if (change.removed) {
+                index.remove(change.key);
+            } else {
+                index.upsert(change.key, change.group, change.fingerprint);
+            }
+        }
+        building_.erase(build);
+        g_memory.charge(memory::DUPLICATE_INDEX, job.user_id, "", index.memory_bytes());
+        users_.emplace(job.user_id, std::move(index));
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::unordered_map<std::string, SimHashIndex> users_;
+    std::unordered_map<std::string, Build> building_;
+    std::deque<Job> queue_;
+    uint64_t next_build_ = 0;
+};
+
+DuplicateIndex g_duplicates;
+
+json duplicates_to_json(const std::vector<CardDuplicate>& duplicates) {
+    auto card_ref = [](const std::string& key) {
+        size_t slash = key.find('/');
+        return json{{"set_id", key.substr(0, slash)}, {"card_id", key.substr(slash + 1)}};
+    };
+    json out = json::array();
+    for (const auto& d : duplicates) {
+        out.push_back({{"distance", d.distance}, {"cards", {card_ref(d.a_key), card_ref(d.b_key)}}});
+    }
+    return out;
+}
+
+const size_t DEFAULT_RELATED_LIMIT = 5;
+const size_t MAX_RELATED_LIMIT = 50;
+
+std::string set_header_text(const std::string& title, const std::string& description) {
+    return title + "\n" + description;
+}
+
+std::string card_text(const Flashcard& card) {
+    return card.front + "\n" + card.back;
+}
+
+// Per-user TF-IDF index with one document per set (title, description and
+// every card), used for related-set suggestions. Built on the first request
+// like the other indexes, then set and card edits add and remove text in
+// place so only the touched set's vector is recomputed.
+class RelatedSets {
+public:
+    void text_added(const std::string& user_id, const std::string& set_id, const std::string& text) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it != users_.end()) {
+            charge_index(memory::RELATED_INDEX, user_id, it->second, [&](TfIdfIndex& index) { index.add_text(set_id, text); });
+        }
+    }
+
+    void text_removed(const std::string& user_id, const std::string& set_id, const std::string& text) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it != users_.end()) {
+            charge_index(memory::RELATED_INDEX, user_id, it->second, [&](TfIdfIndex& index) { index.remove_text(set_id, text); });
+        }
+    }
+
+    void set_removed(const std::string& user_id, const std::string& set_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it != users_.end()) {
+            charge_index(memory::RELATED_INDEX, user_id, it->second, [&](TfIdfIndex& index) { index.remove_doc(set_id); });
+        }
+    }
+
+    void reset(const std::string& user_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) return;
+        g_memory.charge(memory::RELATED_INDEX, user_id, "", -static_cast<int64_t>(it->second.memory_bytes()));
+        users_.erase(it);
+    }
+
+    // Callers hold g_store_mutex.
+    std::vector<TfIdfIndex::Match> related(const std::string& user_id, const std::string& set_id, size_t limit, int64_t now) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) {
+            it = users_.emplace(user_id, build(user_id, now)).first;
+            g_memory.charge(memory::RELATED_INDEX, user_id, "", it->second.memory_bytes());
+        }
+        return it->second.top_k(set_id, limit);
+    }
+
+private:
+    static TfIdfIndex build(const std::string& user_id, int64_t now) {
+        TfIdfIndex index;
+        for (const auto& summary : g_stats.summaries(user_id, static_cast<uint32_t>(now))) {
+            auto set = g_sets.find(summary.first);
+            if (set == g_sets.end()) continue;
+            index.add_text(set->first, set_header_text(set->second.title, set->second.description));
+            for (const auto& card : set->second.cards) index.add_text(set->first, card_text(card));
+        }
+        return index;
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, TfIdfIndex> users_;
+};
+
+RelatedSets g_related;
+
+const size_t DEFAULT_SUGGEST_LIMIT = 8;
+
+// Lowercased title suffixes starting at each word, so "bio" also finds
+// "Cell Biology".
+std::vector<std::string> title_keys(const std::string& title) {
+    std::string lower;
+    for (char c : title) lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < lower.size(); i++) {
+        if (!std::isspace(static_cast<unsigned char>(lower[i])) && (i == 0 || std::isspace(static_cast<unsigned char>(lower[i - 1])))) {
+            keys.push_back(lower.substr(i));
+        }
+    }
+    return keys;
+}
+
+// Per-user radix tree over set titles for search-as-you-type, ranked by
+// when the set was last created, renamed or studied. Built on the first
+// request; afterwards every change re-inserts just the affected title.
+class TitleSuggestions {
+public:
+    void set_titled(const std::string& user_id, const std::string& set_id, const std::string& title, int64_t rank) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) return;
+        charge_index(memory::SUGGEST_INDEX, user_id, it->second, [&](PrefixIndex& index) {
+            for (const auto& key : title_keys(title)) index.insert(key, set_id, rank);
+        });
+    }
+
+    void set_untitled(const std::string& user_id, const std::string& set_id, const std::string& title) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) return;
+        charge_index(memory::SUGGEST_INDEX, user_id, it->second, [&](PrefixIndex& index) {
+            for (const auto& key : title_keys(title)) index.erase(key, set_id);
+        });
+    }
+
+    // Moves a set to the front of the recency order.
+    void touched(const std::string& user_id, const std::string& set_id, const std::string& title, int64_t now) {
+        set_untitled(user_id, set_id, title);
+        set_titled(user_id, set_id, title, now);
+    }
+
+    void reset(const std::string& user_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) return;
+        g_memory.charge(memory::SUGGEST_INDEX, user_id, "", -static_cast<int64_t>(it->second.memory_bytes()));
+        users_.erase(it);
+    }
+
+    // Callers hold g_store_mutex.
+    std::vector<std::string> suggest(const std::string& user_id, const std::string& prefix, size_t limit, int64_t now) {
+        std::string lower;
+        for (char c : prefix) lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = users_.find(user_id);
+        if (it == users_.end()) {
+            it = users_.emplace(user_id, build(user_id, now)).first;
+            g_memory.charge(memory::SUGGEST_INDEX, user_id, "", it->second.memory_bytes());
+        }
+        return it->second.top(lower, limit);
+    }
+
+private:
+    static PrefixIndex build(const std::string& user_id, int64_t now) {
+        PrefixIndex index;
+        for (const auto& summary : g_stats.summaries(user_id, static_cast<uint32_t>(now))) {
+            auto set = g_sets.find(summary.first);
+            if (set == g_sets.end()) continue;
+            // Set ids lead with their creation time (see generate_id()).
+            int64_t rank = std::max<int64_t>(std::strtoll(set->first.c_str(), nullptr, 10), summary.second.last_studied);
+            for (const auto& key : title_keys(set->second.title)) index.insert(key, set->first, rank);
+        }
+        return index;
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, PrefixIndex> users_;
+};
+
+TitleSuggestions g_suggestions;
+
+// Parses the max_distance and limit query parameters shared by the
+// duplicate routes; returns false on malformed input.
+bool parse_duplicate_params(const httplib::Request& req, int& max_distance, size_t& limit) {
+    max_distance = DEFAULT_DUPLICATE_DISTANCE;
+    limit = DEFAULT_DUPLICATE_LIMIT;
+    try {
+        if (req.has_param("max_distance")) max_distance = std::stoi(req.get_param_value("max_distance"));
+        if (req.has_param("limit")) limit = std::min<size_t>(std::stoul(req.get_param_value("limit")), MAX_DUPLICATE_LIMIT);
+    } catch (...) {
+        return false;
+    }
+    return max_distance >= 0 && max_distance <= SimHashIndex::MAX_DISTANCE;
+}
+
+// Builds the sampler for a set. O(set size); callers hold g_store_mutex.
+std::shared_ptr<const QuizSampler> build_quiz_sampler(const FlashcardSet& set, uint32_t day) {
+    std::vector<std::string> card_ids;
+    for (const auto& card : set.cards) card_ids.push_back(card.card_id);
+    std::vector<CardStat> stats = g_stats.lookup(set.user_id, set.set_id, card_ids);
+
+    auto sampler = std::make_shared<QuizSampler>();
+    sampler->day = day;
+    for (const auto& stat : stats) {
+        sampler->weights.push_back(quiz_card_weight(stat, day * SECONDS_PER_DAY));
+    }
+    sampler->table = AliasTable(sampler->weights);
+    return sampler;
+}
+
+// Picks count distinct card indices, favouring heavier cards. Small quizzes
+// draw from the alias table and reject repeats, so they cost O(count); a quiz
+// covering more than half the set orders the whole set by weighted keys.
+std::vector<size_t> sample_quiz(const QuizSampler& sampler, size_t count) {
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    size_t n = sampler.weights.size();
+    std::vector<size_t> picked;
+    if (n == 0) {
+        return picked;
+    }
+
+    if (count * 2 > n) {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::vector<std::pair<double, size_t>> keyed;
+        for (size_t i = 0; i < n; i++) {
+            keyed.emplace_back(std::pow(unit(rng), 1.0 / sampler.weights[i]), i);
+        }
+        std::sort(keyed.rbegin(), keyed.rend());
+        for (size_t i = 0; i < std::min(count, n); i++) picked.push_back(keyed[i].second);
+        return picked;
+    }
+
+    std::unordered_set<size_t> seen;
+    for (size_t draws = 0; picked.size() < count && draws < 8 * count + 64; draws++) {
+        size_t i = sampler.table.sample(rng);
+        if (seen.insert(i).second) picked.push_back(i);
+    }
+    return picked;
+}
+
+// Set while a /api/batch request runs its sub-requests on this thread, so
+// each mutation marks the store dirty instead of rewriting DATA_FILE.
+thread_local bool t_defer_save = false;
+thread_local bool t_save_pending = false;
+
+// A copy of the store taken under g_store_mutex, written to DATA_FILE
+// without it. Generations order snapshots, so a slow writer never replaces
+// a newer file with an older one.
+struct DataSnapshot {
+    json data;
+    uint64_t generation = 0;
+};
+
+std::atomic<uint64_t> g_data_generation{0};
+std::mutex g_data_file_mutex;
+uint64_t g_data_written_generation = 0; // guarded by g_data_file_mutex
+thread_local std::unique_ptr<DataSnapshot> t_deferred_save;
+
+// Callers hold g_store_mutex.
+DataSnapshot build_data_snapshot() {
+    tracing::Span build("save_data_build");
+    DataSnapshot snapshot;
+    snapshot.generation = ++g_data_generation;
+    json& j = snapshot.data;
     j["users"] = g_users; 
-    j["sets"] = g_sets; 
-    
+
+    // Sets that still share card storage with a clone write the cards once;
+    // the others point at that set through "cards_ref".
+    std::map<const void*, std::string> card_owners;
+    json sets_json = json::object();
+    for (const auto& pair : g_sets) {
+        const FlashcardSet& set = pair.second;
+        auto owner = card_owners.find(set.cards.storage_id());
+        if (owner == card_owners.end()) {
+            card_owners[set.cards.storage_id()] = set.set_id;
+            sets_json[pair.first] = set;
+        } else {
+            json set_json = set;
+            set_json.erase("cards");
+            set_json["cards_ref"] = owner->second;
+            sets_json[pair.first] = set_json;
+        }
+    }
+    j["sets"] = sets_json; 
+    g_stats.dirty = false;
+    j["stats"] = g_stats.to_json();
+    return snapshot;
+}
+
+// Does not need g_store_mutex.
+void write_data_snapshot(const DataSnapshot& snapshot) {
+    metrics::ScopedTimer timer(g_persistence_latency, "op=\"save_data\"");
+    tracing::Span write("save_data_write");
+    std::lock_guard<std::mutex> lock(g_data_file_mutex);
+    if (snapshot.generation < g_data_written_generation) {
+        return; // a newer snapshot is already on disk
+    }
     std::ofstream o(DATA_FILE); 
     
     if (o.is_open()) {
-        o << std::setw(4) << j << std::endl;
+        o << std::setw(4) << snapshot.data << "\n";
         o.close();
-        std::cout << "SUCCESS: Data saved to " << DATA_FILE << std::endl;
+        g_data_written_generation = snapshot.generation;
+        logging::debug("data_saved").str("file", DATA_FILE);
     } else {
-        std::cerr << "ERROR: Could not open " << DATA_FILE << " for writing!" << std::endl;
+        logging::error("data_save_failed").str("file", DATA_FILE);
     }
 }
 
+// Callers hold g_store_mutex. Under a StoreWriteLock only the snapshot is
+// taken here, and the lock's destructor writes it.
+void saveData() {
+    if (t_defer_save) {
+        t_save_pending = true;
+        return;
+    }
+    tracing::Span span("save_data");
+    DataSnapshot snapshot = build_data_snapshot();
+    if (t_in_store_write) {
+        t_deferred_save.reset(new DataSnapshot(std::move(snapshot)));
+        return;
+    }
+    write_data_snapshot(snapshot);
+}
+
+void write_deferred_save() {
+    if (!t_deferred_save) return;
+    std::unique_ptr<DataSnapshot> snapshot = std::move(t_deferred_save);
+    write_data_snapshot(*snapshot);
+}
+
 void loadData() {
+    metrics::ScopedTimer timer(g_persistence_latency, "op=\"load_data\"");
     std::ifstream i(DATA_FILE);
     if (i.is_open()) {
         try {
@@ -117,28 +1487,529 @@ void loadData() {
 
             g_users = j.at("users").get<std::map<std::string, User>>();
             g_sets = j.at("sets").get<std::map<std::string, FlashcardSet>>();
+            for (const auto& item : j.at("sets").items()) {
+                if (item.value().contains("cards_ref")) {
+                    std::string owner = item.value().at("cards_ref");
+                    if (g_sets.count(owner)) {
+                        g_sets.at(item.key()).cards = g_sets.at(owner).cards;
+                    }
+                }
+            }
+            for (const auto& pair : g_users) {
+                g_memory.charge(memory::USERS, pair.first, "", user_bytes(pair.second));
+            }
+            for (const auto& pair : g_sets) {
+                g_stats.set_added(pair.second.user_id, pair.first, static_cast<uint32_t>(pair.second.cards.size()));
+                g_tags.set_added(pair.second);
+                charge_set(pair.second, 1);
+            }
+            if (j.contains("stats")) {
+                g_stats.from_json(j.at("stats"));
+            }
             
             i.close();
-            std::cout << "SUCCESS: Data loaded from " << DATA_FILE << ". " 
-                      << g_users.size() << " users and " << g_sets.size() << " sets restored." << std::endl;
+            logging::info("data_loaded").str("file", DATA_FILE).num("users", g_users.size()).num("sets", g_sets.size());
         } catch (const json::exception& e) {
-            std::cerr << "ERROR: Failed to parse JSON data in " << DATA_FILE << ": " << e.what() << std::endl;
+            logging::error("data_parse_failed").str("file", DATA_FILE).str("error", e.what());
         }
     } else {
-        std::cout << "INFO: No existing data file found (" << DATA_FILE << "). Starting fresh." << std::endl;
+        logging::info("data_missing").str("file", DATA_FILE);
     }
 }
 
 
+struct Session {
+    std::string user_id;
+    int64_t created_at = 0;
+    int64_t last_seen = 0;
+    int64_t saved_last_seen = 0; // last_seen as of the last save; not persisted
+
+    int64_t expires_at() const {
+        return std::min(last_seen + SESSION_IDLE_TTL_SECONDS, created_at + SESSION_ABSOLUTE_TTL_SECONDS);
+    }
+};
+
+void to_json(json& j, const Session& p) {
+    j = json{{"user_id", p.user_id}, {"created_at", p.created_at}, {"last_seen", p.last_seen}};
+}
+
+void from_json(const json& j, Session& p) {
+    p.user_id = j.at("user_id");
+    p.created_at = j.at("created_at");
+    p.last_seen = j.at("last_seen");
+}
+
+int64_t unix_now() {
+    return static_cast<int64_t>(std::time(nullptr));
+}
+
+// Bearer token -> Session, sharded so validating a token is one hash probe
+// under one shard's lock. Expiry is driven by a TimerWheel keyed on each
+// session's deadline; sessions that were touched since they were scheduled
+// are simply re-armed when their slot fires.
+class SessionStore {
+public:
+    static const size_t SHARDS = 16;
+
+    SessionStore() : wheel_(unix_now()) {}
+
+    std::string create(const std::string& user_id) {
+        std::string token = random_token();
+        Session session;
+        session.user_id = user_id;
+        session.created_at = unix_now();
+        session.last_seen = session.created_at;
+        session.saved_last_seen = session.created_at;
+        {
+            Shard& shard = shard_for(token);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.sessions[token] = session;
+        }
+        g_memory.charge(memory::SESSIONS, user_id, "", session_bytes(token, session));
+        arm(token, session.expires_at());
+        dirty_ = true;
+        return token;
+    }
+
+    // Returns the session's user id and refreshes its idle deadline, or ""
+    // for unknown and expired tokens.
+    std::string validate(const std::string& token) {
+        Shard& shard = shard_for(token);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.sessions.find(token);
+        if (it == shard.sessions.end()) {
+            return "";
+        }
+        int64_t now = unix_now();
+        if (it->second.expires_at() <= now) {
+            g_memory.charge(memory::SESSIONS, it->second.user_id, "", -session_bytes(token, it->second));
+            shard.sessions.erase(it);
+            dirty_ = true;
+            return "";
+        }
+        it->second.last_seen = now;
+        if (now - it->second.saved_last_seen >= SESSION_TOUCH_SAVE_SECONDS) dirty_ = true;
+        return it->second.user_id;
+    }
+
+    void revoke(const std::string& token) {
+        Shard& shard = shard_for(token);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.sessions.find(token);
+        if (it != shard.sessions.end()) {
+            g_memory.charge(memory::SESSIONS, it->second.user_id, "", -session_bytes(token, it->second));
+            shard.sessions.erase(it);
+            dirty_ = true;
+        }
+    }
+
+    // Advances the timer wheel to now and drops every session whose deadline
+    // has passed. Called once per tick from the expiry thread.
+    void expire(int64_t now) {
+        std::vector<std::string> due;
+        {
+            std::lock_guard<std::mutex> lock(wheel_mutex_);
+            wheel_.advance(now, [&due](const std::string& token) { due.push_back(token); });
+        }
+
+        std::vector<std::pair<std::string, int64_t>> rearm;
+        for (const auto& token : due) {
+            Shard& shard = shard_for(token);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.sessions.find(token);
+            if (it == shard.sessions.end()) {
+                continue;
+            }
+            if (it->second.expires_at() <= now) {
+                g_memory.charge(memory::SESSIONS, it->second.user_id, "", -session_bytes(token, it->second));
+                shard.sessions.erase(it);
+                dirty_ = true;
+            } else {
+                rearm.emplace_back(token, it->second.expires_at());
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        for (auto& entry : rearm) {
+            wheel_.schedule(entry.second, std::move(entry.first));
+        }
+    }
+
+    void save() {
+        metrics::ScopedTimer timer(g_persistence_latency, "op=\"save_sessions\"");
+        json j = json::object();
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto& pair : shard.sessions) {
+                j[pair.first] = pair.second;
+                pair.second.saved_last_seen = pair.second.last_seen;
+            }
+        }
+
+        std::ofstream o(SESSIONS_FILE);
+        if (o.is_open()) {
+            o << j << "\n";
+        } else {
+            logging::error("sessions_save_failed").str("file", SESSIONS_FILE);
+        }
+    }
+
+    // Writes SESSIONS_FILE if any session was created or dropped, or has been
+    // active SESSION_TOUCH_SAVE_SECONDS past its saved last_seen, since the
+    // last save.
+    void save_if_dirty() {
+        if (dirty_.exchange(false)) {
+            save();
+        }
+    }
+
+    void load() {
+        std::ifstream i(SESSIONS_FILE);
+        if (!i.is_open()) {
+            return;
+        }
+        try {
+            json j;
+            i >> j;
+            int64_t now = unix_now();
+            size_t restored = 0;
+            for (const auto& item : j.items()) {
+                Session session = item.value().get<Session>();
+                session.saved_last_seen = session.last_seen;
+                if (session.expires_at() <= now) {
+                    continue;
+                }
+                Shard& shard = shard_for(item.key());
+                {
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    shard.sessions[item.key()] = session;
+                }
+                g_memory.charge(memory::SESSIONS, session.user_id, "", session_bytes(item.key(), session));
+                arm(item.key(), session.expires_at());
+                restored++;
+            }
+            logging::info("sessions_loaded").str("file", SESSIONS_FILE).num("sessions", restored);
+        } catch (const json::exception& e) {
+            logging::error("sessions_parse_failed").str("file", SESSIONS_FILE).str("error", e.what());
+        }
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Session> sessions;
+    };
+
+    Shard& shard_for(const std::string& token) {
+        return shards_[std::hash<std::string>()(token) % SHARDS];
+    }
+
+    // The map entry plus the token's copy in the timer wheel.
+    static int64_t session_bytes(const std::string& token, const Session& session) {
+        return memory::HASH_NODE_BYTES + 2 * memory::string_bytes(token) + sizeof(Session) + memory::heap_bytes(session.user_id);
+    }
+
+    void arm(const std::string& token, int64_t when) {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        wheel_.schedule(when, token);
+    }
+
+    static std::string random_token() {
+        static const char* HEX = "0123456789abcdef";
+        std::random_device rd;
+        std::string token;
+        token.reserve(64);
+        for (int i = 0; i < 8; i++) {
+            uint32_t word = rd();
+            for (int b = 0; b < 8; b++) {
+                token += HEX[(word >> (b * 4)) & 0xF];
+            }
+        }
+        return token;
+    }
+
+    Shard shards_[SHARDS];
+    std::mutex wheel_mutex_;
+    TimerWheel<std::string> wheel_;
+    std::atomic<bool> dirty_{false};
+};
+
+SessionStore g_sessions;
+
+// Set by the pre-routing handler; httplib runs pre-routing, the route and
+// post-routing for a request on the same thread.
+thread_local std::chrono::steady_clock::time_point t_request_started;
+thread_local bool t_request_active = false;
+thread_local lanes::Lane t_request_lane = lanes::LANES; // LANES: holds no slot
+
+// The lane a request runs in, or false for requests that bypass the lanes
+// (metrics, admin and CORS preflight), which must answer even when every
+// lane is saturated. Quiz generation is a POST but only reads.
+bool classify_lane(const httplib::Request& req, lanes::Lane& lane) {
+    if (req.method == "OPTIONS" || req.path.compare(0, 5, "/api/") != 0) return false;
+    if (req.method == "POST" && (req.path == "/api/login" || req.path == "/api/register")) {
+        lane = lanes::EXPENSIVE;
+    } else if (req.method == "GET" || (req.method == "POST" && req.path.size() > 5 &&
+                                      req.path.compare(req.path.size() - 5, 5, "/quiz") == 0)) {
+        lane = lanes::READ;
+    } else {
+        lane = lanes::WRITE;
+    }
+    return true;
+}
+
+std::string prometheus_label(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') out += '\\';
+        if (c == '\n') { out += "\\n"; continue; }
+        out += c;
+    }
+    return out;
+}
+
+// One access log line per request; FLIPIT_ACCESS_LOG=0 turns it off.
+bool g_access_log = true;
+
+// Called from the post-routing handler: records the latency histogram and
+// writes the access log line.
+void finish_request(const httplib::Request& req, const httplib::Response& res) {
+    auto elapsed = std::chrono::steady_clock::now() - t_request_started;
+    uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    const std::string& route = req.matched_route.empty() ? "unmatched" : req.matched_route;
+    std::string labels = "method=\"" + prometheus_label(req.method) +
+                         "\",route=\"" + prometheus_label(route) +
+                         "\",status=\"" + std::to_string(res.status) + "\"";
+    g_request_latency.record(labels, elapsed_us);
+    g_tracer.end_request(req.method + " " + route, req.path, res.status);
+
+    if (g_access_log) {
+        logging::info("access").unlimited()
+            .str("method", req.method)
+            .str("path", req.path)
+            .str("route", route)
+            .num("status", res.status)
+            .num("duration_us", elapsed_us)
+            .num("bytes", res.body.size())
+            .str("remote", req.remote_addr)
+            .str("trace_id", tracing::current_trace_id());
+    }
+}
+
+// Once-a-second housekeeping: session expiry plus persisting state that is
+// updated too often to rewrite on every request.
+void maintenance_loop() {
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        g_sessions.expire(unix_now());
+        g_sessions.save_if_dirty();
+        {
+            metrics::ScopedTimer timer(g_persistence_latency, "op=\"flush_events\"");
+            g_events.flush(unix_now());
+        }
+        g_tracer.flush();
+
+        if (g_stats.dirty) {
+            DataSnapshot snapshot;
+            {
+                std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+                snapshot = build_data_snapshot();
+            }
+            write_data_snapshot(snapshot);
+        }
+    }
+}
+
+
+// Callers hold g_store_mutex.
+const User* find_user_by_username(const std::string& username) {
+    for (const auto& pair : g_users) {
+        if (pair.second.username == username) return &pair.second;
+    }
+    return nullptr;
+}
+
 std::string generate_id() {
     return std::to_string(std::time(nullptr)) + "-" + std::to_string(std::rand());
 }
 
-std::string hash_password(const std::string& password) {
-    return "hashed_" + password;
-}
+// scrypt cost used for new hashes. Stored hashes carry their own parameters,
+// and any hash made with a different cost is upgraded on the next login.
+struct KdfParams {
+    int log2_n = 15;
+    uint32_t r = 8;
+    uint32_t p = 1;
+
+    // Accepted FLIPIT_KDF_* values. N = 2^log2_n must be a power of two
+    // above one, and each hash allocates 128 * r * N bytes.
+    static const int MAX_LOG2_N = 24;
+    static const uint32_t MAX_R = 32;
+    static const uint32_t MAX_P = 16;
+    static const uint64_t MAX_BYTES = uint64_t(1) << 30;
+
+    static bool valid(size_t log2_n, size_t r, size_t p) {
+        return log2_n >= 1 && log2_n <= MAX_LOG2_N && r >= 1 && r <= MAX_R && p >= 1 && p <= MAX_P &&
+               (uint64_t(128) * r << log2_n) <= MAX_BYTES;
+    }
+};
+
+KdfParams g_kdf_params;
+
+// Password hashing runs here instead of on httplib's request threads so a
+// login storm cannot take every worker; when the queue is full the request
+// is shed with a 503.
+std::unique_ptr<BoundedWorkerPool> g_kdf_pool;
+
+const size_t KDF_SALT_BYTES = 16;
+const size_t KDF_HASH_BYTES = 32;
+
+size_t env_or(const char* name, size_t fallback) {
+    const char* value = std::getenv(name);
+    return value ? static_cast<size_t>(std::strtoul(value, nullptr, 10)) : fallback;
+}
+
+std::string to_hex(const std::vector<uint8_t>& bytes) {
+    static const char* HEX = "0123456789abcdef";
+    std::string out;
+    for (uint8_t b : bytes) {
+        out += HEX[b >> 4];
+        out += HEX[b & 0xF];
+    }
+    return out;
+}
+
+std::vector<uint8_t> from_hex(const std::string& hex) {
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        out.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+    }
+    return out;
+}
+
+// Produces "scrypt$<log2 N>$<r>$<p>$<salt hex>$<hash hex>".
+std::string hash_password(const std::string& password) {
+    std::random_device rd;
+    std::vector<uint8_t> salt(KDF_SALT_BYTES);
+    for (auto& b : salt) b = static_cast<uint8_t>(rd());
+
+    const KdfParams& k = g_kdf_params;
+    std::vector<uint8_t> hash = scrypt::derive(password, salt, uint64_t(1) << k.log2_n, k.r, k.p, KDF_HASH_BYTES);
+    return "scrypt$" + std::to_string(k.log2_n) + "$" + std::to_string(k.r) + "$" + std::to_string(k.p) + "$" +
+           to_hex(salt) + "$" + to_hex(hash);
+}
+
+// Checks password against a stored hash. Sets needs_rehash when the stored
+// hash is the legacy "hashed_" form or was made with a different cost.
+bool verify_password(const std::string& password, const std::string& stored, bool& needs_rehash) {
+    needs_rehash = false;
+    if (stored.rfind("scrypt$", 0) != 0) {
+        needs_rehash = true;
+        return stored == "hashed_" + password;
+    }
+
+    std::vector<std::string> parts;
+    std::stringstream ss(stored);
+    std::string part;
+    while (std::getline(ss, part, '$')) parts.push_back(part);
+    if (parts.size() != 6) return false;
+
+    int log2_n = std::stoi(parts[1]);
+    uint32_t r = static_cast<uint32_t>(std::stoul(parts[2]));
+    uint32_t p = static_cast<uint32_t>(std::stoul(parts[3]));
+    std::vector<uint8_t> expected = from_hex(parts[5]);
+    std::vector<uint8_t> actual = scrypt::derive(password, from_hex(parts[4]), uint64_t(1) << log2_n, r, p, expected.size());
+
+    uint8_t diff = actual.size() == expected.size() ? 0 : 1;
+    for (size_t i = 0; i < actual.size() && i < expected.size(); i++) {
+        diff |= actual[i] ^ expected[i];
+    }
+
+    const KdfParams& k = g_kdf_params;
+    needs_rehash = log2_n != k.log2_n || r != k.r || p != k.p;
+    return diff == 0;
+}
+
+struct PasswordCheck {
+    bool ok = false;
+    std::string new_hash;
+};
+
+// Runs fn on g_kdf_pool and waits for it. Returns false without running fn
+// when the pool's queue is full.
+template <typename T>
+bool run_on_kdf_pool(std::function<T()> fn, T& result) {
+    auto task = std::make_shared<std::packaged_task<T()>>(std::move(fn));
+    std::future<T> done = task->get_future();
+    tracing::Span span("kdf_wait");
+    if (!g_kdf_pool->try_submit([task] { (*task)(); })) {
+        return false;
+    }
+    result = done.get();
+    return true;
+}
+
+void respond_kdf_busy(httplib::Response& res) {
+    res.status = 503;
+    res.set_header("Retry-After", "1");
+    res.set_content("{\"error\": \"Server busy, please retry\"}", "application/json");
+}
+
+// Token for the /debug and /admin endpoints, from FLIPIT_ADMIN_TOKEN; they
+// are refused while it is unset.
+std::string g_admin_token;
+
+const size_t DEFAULT_MEMORY_TOP = 10;
+const size_t MAX_MEMORY_TOP = 1000;
+const int DEFAULT_PROFILE_SECONDS = 10;
+const int MAX_PROFILE_SECONDS = 120;
+const int DEFAULT_PROFILE_HZ = 99;
+const int MAX_PROFILE_HZ = 1000;
+
+bool is_admin_request(const httplib::Request& req) {
+    std::string given = req.get_header_value("X-Admin-Token");
+    if (g_admin_token.empty() || given.size() != g_admin_token.size()) {
+        return false;
+    }
+    uint8_t diff = 0;
+    for (size_t i = 0; i < given.size(); i++) {
+        diff |= given[i] ^ g_admin_token[i];
+    }
+    return diff == 0;
+}
+
+// Identity established once by /api/batch and reused by its sub-requests.
+thread_local std::string t_batch_user_id;
+
+// Holds the batch identity and deferred saves for one /api/batch request and
+// restores both however it exits, so a throw cannot leave the next request
+// on this worker authenticated as the batch user. Writes any deferred save.
+class BatchScope {
+public:
+    explicit BatchScope(const std::string& user_id) {
+        t_batch_user_id = user_id;
+        t_defer_save = true;
+        t_save_pending = false;
+    }
+
+    ~BatchScope() {
+        t_batch_user_id.clear();
+        t_defer_save = false;
+        if (t_save_pending) {
+            t_save_pending = false;
+            StoreWriteLock lock;
+            saveData();
+        }
+    }
+
+    BatchScope(const BatchScope&) = delete;
+    BatchScope& operator=(const BatchScope&) = delete;
+};
 
 std::string authenticate_request(const httplib::Request& req) {
+    tracing::Span span("authenticate");
+    if (!t_batch_user_id.empty()) {
+        return t_batch_user_id;
+    }
     auto it = req.headers.find("Authorization");
     if (it == req.headers.end()) {
         return "";
@@ -146,8 +2017,9 @@ std::string authenticate_request(const httplib::Request& req) {
     std::string auth_header = it->second;
     if (auth_header.length() > 7 && auth_header.substr(0, 7) == "Bearer ") {
         std::string token = auth_header.substr(7);
-        if (g_users.count(token)) { 
-            return token; 
+        std::string user_id = g_sessions.validate(token);
+        if (!user_id.empty() && g_users.count(user_id)) { 
+            return user_id; 
         }
     }
     return "";
@@ -155,45 +2027,271 @@ std::string authenticate_request(const httplib::Request& req) {
 
 
 
+// json::parse and dump() for request and response bodies, traced as phases.
+json parse_body(const std::string& body) {
+    tracing::Span span("json_parse");
+    return json::parse(body);
+}
+
+std::string dump_body(const json& value) {
+    tracing::Span span("json_dump");
+    return value.dump();
+}
+
 json card_to_json(const Flashcard& card) {
     return card; 
 }
 
 json set_to_json(const FlashcardSet& set, bool include_cards = true) {
     
-    json set_json = set;
+    json set_json = {
+        {"set_id", set.set_id}, 
+        {"user_id", set.user_id}, 
+        {"title", set.title}, 
+        {"description", set.description}
+    };
     
     set_json["card_count"] = set.cards.size();
+    set_json["tags"] = set.tags;
     
-    if (!include_cards) {
-        set_json.erase("cards");
+    if (include_cards) {
+        set_json["cards"] = set.cards;
     }
     return set_json;
 }
 
+// Dashboard entry built from the set header and its SetSummary alone.
+json set_summary_to_json(const FlashcardSet& set, const SetSummary& summary, uint32_t now) {
+    uint32_t due_count = 0;
+    for (const auto& day : summary.due_by_day) {
+        if (day.first > now / SECONDS_PER_DAY) break;
+        due_count += day.second;
+    }
+    return json{
+        {"set_id", set.set_id}, 
+        {"user_id", set.user_id}, 
+        {"title", set.title}, 
+        {"description", set.description},
+        {"card_count", summary.card_count},
+        {"tags", set.tags},
+        {"mastery", summary.card_count ? 100.0 * summary.mastered / summary.card_count : 0.0},
+        {"due_count", due_count},
+        {"last_studied", summary.last_studied}
+    };
+}
+
+
+// Cards serialized per provider call in /api/export; bounds both the time
+// g_store_mutex is held and the size of each chunk on the wire.
+const size_t EXPORT_CARDS_PER_CHUNK = 256;
+
+std::string csv_escape(const std::string& field) {
+    if (field.find_first_of(",\"\r\n") == std::string::npos) {
+        return field;
+    }
+    std::string out = "\"";
+    for (char c : field) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += "\"";
+    return out;
+}
+
+std::string export_csv_row(const FlashcardSet& set, const Flashcard* card) {
+    std::string row = csv_escape(set.set_id) + "," + csv_escape(set.title) + "," + csv_escape(set.description) + ",";
+    if (card) {
+        row += csv_escape(card->card_id) + "," + csv_escape(card->front) + "," + csv_escape(card->back);
+    } else {
+        row += ",,";
+    }
+    return row + "\r\n";
+}
+
+// Walks a user's library one chunk at a time. Only the set ids are captured
+// up front; set and card contents are read from g_sets as the client drains
+// the response, so sets deleted mid-export are skipped and edits made after
+// a set's chunk was sent are not reflected.
+struct ExportCursor {
+    bool csv = false;
+    std::vector<std::string> set_ids;
+    size_t set_index = 0;
+    size_t card_index = 0;
+    bool header_sent = false;
+    bool set_started = false;
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    std::unique_ptr<httplib::detail::gzip_compressor> gzip;
+#endif
+
+    // Appends the next chunk to out. Returns false once the library is exhausted.
+    bool next_chunk(std::string& out) {
+        if (!header_sent) {
+            header_sent = true;
+            if (csv) out += "set_id,set_title,set_description,card_id,front,back\r\n";
+        }
+
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        size_t budget = EXPORT_CARDS_PER_CHUNK;
+        while (budget > 0 && set_index < set_ids.size()) {
+            auto it = g_sets.find(set_ids[set_index]);
+            if (it == g_sets.end()) {
+                set_index++;
+                continue;
+            }
+            const FlashcardSet& set = it->second;
+
+            if (!set_started) {
+                set_started = true;
+                if (!csv) {
+                    json set_json = set_to_json(set, false);
+                    set_json["type"] = "set";
+                    out += set_json.dump() + "\n";
+                } else if (set.cards.empty()) {
+                    out += export_csv_row(set, nullptr);
+                }
+            }
+
+            for (; budget > 0 && card_index < set.cards.size(); budget--, card_index++) {
+                const Flashcard& card = set.cards[card_index];
+                if (csv) {
+                    out += export_csv_row(set, &card);
+                } else {
+                    json card_json = card_to_json(card);
+                    card_json["type"] = "card";
+                    card_json["set_id"] = set.set_id;
+                    out += card_json.dump() + "\n";
+                }
+            }
+
+            if (card_index >= set.cards.size()) {
+                set_index++;
+                card_index = 0;
+                set_started = false;
+            }
+        }
+        return set_index < set_ids.size();
+    }
+};
+
+
+
+struct BatchRoute {
+    std::string method;
+    std::regex pattern;
+    httplib::Server::Handler handler;
+};
+
+// Every route registered through add_route() can also be invoked as a
+// sub-request of POST /api/batch, except the scrypt-bound auth routes: run
+// inside a batch they would escape the expensive lane's budget.
+std::vector<BatchRoute> g_batch_routes;
+
+const size_t MAX_BATCH_REQUESTS = 100;
+const std::set<std::string> UNBATCHABLE_ROUTES = {"/api/register", "/api/login"};
+
+void add_route(httplib::Server& svr, const std::string& method, const std::string& pattern, httplib::Server::Handler handler) {
+    if (!UNBATCHABLE_ROUTES.count(pattern)) g_batch_routes.push_back({method, std::regex(pattern), handler});
+    httplib::Server::Handler traced = [handler](const httplib::Request& req, httplib::Response& res) {
+        g_tracer.route_matched();
+        tracing::Span span("handler");
+        handler(req, res);
+    };
+    if (method == "GET") svr.Get(pattern, traced);
+    else if (method == "POST") svr.Post(pattern, traced);
+    else if (method == "PUT") svr.Put(pattern, traced);
+    else if (method == "DELETE") svr.Delete(pattern, traced);
+}
+
+json run_batch_request(const httplib::Request& parent, const json& sub) {
+    tracing::Span span("batch_request");
+    httplib::Request sub_req;
+    sub_req.method = sub.at("method").get<std::string>();
+    std::transform(sub_req.method.begin(), sub_req.method.end(), sub_req.method.begin(), ::toupper);
+    std::string target = sub.at("path");
+    if (sub.contains("body")) {
+        sub_req.body = sub.at("body").is_string() ? sub.at("body").get<std::string>() : sub.at("body").dump();
+    }
+    sub_req.headers = parent.headers;
+
+    size_t query_pos = target.find('?');
+    sub_req.path = target.substr(0, query_pos);
+    if (query_pos != std::string::npos) {
+        httplib::detail::parse_query_text(target.substr(query_pos + 1), sub_req.params);
+    }
+
+    httplib::Response sub_res;
+    const BatchRoute* route = nullptr;
+    for (const auto& candidate : g_batch_routes) {
+        if (candidate.method == sub_req.method && std::regex_match(sub_req.path, sub_req.matches, candidate.pattern)) {
+            route = &candidate;
+            break;
+        }
+    }
+
+    if (route) {
+        route->handler(sub_req, sub_res);
+        // As in httplib, a handler that sets no status answered 200.
+        if (sub_res.status == -1) sub_res.status = 200;
+        // A streaming handler (/api/export) leaves its body to a chunked
+        // content provider; run it to the end to get the sub-response body.
+        if (sub_res.content_provider_ && sub_res.is_chunked_content_provider_) {
+            bool done = false;
+            httplib::DataSink sink;
+            sink.write = [&sub_res](const char* data, size_t len) { sub_res.body.append(data, len); return true; };
+            sink.is_writable = [] { return true; };
+            sink.done = [&done] { done = true; };
+            while (!done && sub_res.content_provider_(sub_res.body.size(), 0, sink)) {}
+        }
+    } else {
+        sub_res.status = 404;
+        sub_res.body = "{\"error\": \"No batchable route for " + sub_req.method + " " + sub_req.path + "\"}";
+    }
 
+    json body = json::parse(sub_res.body, nullptr, false);
+    if (body.is_discarded()) body = sub_res.body;
+    return json{{"status", sub_res.status}, {"body", body}};
+}
 
 void setup_routes(httplib::Server& svr) {
     
     
-    svr.Post("/api/register", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "POST", "/api/register", [](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*"); 
         try {
-            auto req_json = json::parse(req.body);
+            auto req_json = parse_body(req.body);
             std::string username = req_json.at("username");
             std::string password = req_json.at("password");
 
-            for (const auto& pair : g_users) {
-                if (pair.second.username == username) {
-                    res.status = 409; 
-                    res.set_content("{\"error\": \"Username already exists\"}", "application/json");
-                    return;
-                }
+            auto username_taken = [&username]() { return find_user_by_username(username) != nullptr; };
+
+            bool taken;
+            {
+                std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+                taken = username_taken();
+            }
+            if (taken) {
+                res.status = 409; 
+                res.set_content("{\"error\": \"Username already exists\"}", "application/json");
+                return;
+            }
+
+            std::string password_hash;
+            if (!run_on_kdf_pool<std::string>([&password]() { return hash_password(password); }, password_hash)) {
+                respond_kdf_busy(res);
+                return;
+            }
+
+            StoreWriteLock lock;
+            if (username_taken()) {
+                res.status = 409; 
+                res.set_content("{\"error\": \"Username already exists\"}", "application/json");
+                return;
             }
 
             std::string new_user_id = generate_id();
-            User new_user = {new_user_id, username, hash_password(password)};
+            User new_user = {new_user_id, username, password_hash};
             g_users[new_user_id] = new_user;
+            g_memory.charge(memory::USERS, new_user_id, "", user_bytes(new_user));
             
             saveData(); 
 
@@ -202,7 +2300,7 @@ void setup_routes(httplib::Server& svr) {
                 {"user_id", new_user_id}
             };
             res.status = 201; 
-            res.set_content(response_json.dump(), "application/json");
+            res.set_content(dump_body(response_json), "application/json");
 
         } catch (...) {
             res.status = 400;
@@ -211,31 +2309,59 @@ void setup_routes(httplib::Server& svr) {
     });
 
     
-    svr.Post("/api/login", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "POST", "/api/login", [](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*"); 
 
         try {
-            auto req_json = json::parse(req.body);
+            auto req_json = parse_body(req.body);
             std::string username = req_json.at("username");
             std::string password = req_json.at("password");
 
             User found_user;
             bool user_found = false;
-            for (const auto& pair : g_users) {
-                if (pair.second.username == username) {
-                    found_user = pair.second;
+            {
+                std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+                if (const User* user = find_user_by_username(username)) {
+                    found_user = *user;
                     user_found = true;
-                    break;
                 }
             }
 
-            if (user_found && found_user.password_hash == hash_password(password)) {
+            // Verifies and, when the stored hash is outdated, re-hashes in the
+            // same pool job.
+            PasswordCheck check;
+            if (user_found) {
+                std::string stored_hash = found_user.password_hash;
+                auto verify = [&password, stored_hash]() {
+                    PasswordCheck result;
+                    bool needs_rehash = false;
+                    result.ok = verify_password(password, stored_hash, needs_rehash);
+                    if (result.ok && needs_rehash) result.new_hash = hash_password(password);
+                    return result;
+                };
+                if (!run_on_kdf_pool<PasswordCheck>(verify, check)) {
+                    respond_kdf_busy(res);
+                    return;
+                }
+            }
+
+            if (!check.new_hash.empty()) {
+                StoreWriteLock lock;
+                auto it = g_users.find(found_user.user_id);
+                if (it != g_users.end() && it->second.password_hash == found_user.password_hash) {
+                    it->second.password_hash = check.new_hash;
+                    saveData(); 
+                }
+            }
+
+            if (check.ok) {
                 json response_json = {
                     {"message", "Login successful"},
-                    {"user_id", found_user.user_id} 
+                    {"user_id", found_user.user_id},
+                    {"token", g_sessions.create(found_user.user_id)}
                 };
                 res.status = 200;
-                res.set_content(response_json.dump(), "application/json");
+                res.set_content(dump_body(response_json), "application/json");
             } else {
                 res.status = 401; 
                 res.set_content("{\"error\": \"Invalid username or password\"}", "application/json");
@@ -247,84 +2373,302 @@ void setup_routes(httplib::Server& svr) {
     });
 
     
-    svr.Get("/api/sets", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "POST", "/api/logout", [](const httplib::Request& req, httplib::Response& res) {
+        std::string auth_header = req.get_header_value("Authorization");
+        if (auth_header.length() > 7 && auth_header.substr(0, 7) == "Bearer ") {
+            g_sessions.revoke(auth_header.substr(7));
+        }
+        res.set_content("{\"message\": \"Logged out\"}", "application/json");
+    });
+
+    
+    add_route(svr, "GET", "/api/sets", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
         std::string user_id = authenticate_request(req);
         if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
+        uint32_t now = static_cast<uint32_t>(unix_now());
         json sets_list = json::array();
-        for (const auto& pair : g_sets) {
-            if (pair.second.user_id == user_id) {
-                
-                sets_list.push_back(set_to_json(pair.second, false)); 
+        auto summaries = g_stats.summaries(user_id, now);
+
+        // ?all=a,b&any=c,d&not=e filters by tag; without them every set is listed.
+        if (req.has_param("all") || req.has_param("any") || req.has_param("not")) {
+            auto tag_list = [&req](const char* name) {
+                std::vector<std::string> tags;
+                std::stringstream ss(req.get_param_value(name));
+                std::string tag;
+                while (std::getline(ss, tag, ',')) {
+                    for (auto& c : tag) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                    if (!tag.empty()) tags.push_back(tag);
+                }
+                return tags;
+            };
+            for (const auto& set_id : g_tags.filter(user_id, tag_list("all"), tag_list("any"), tag_list("not"))) {
+                auto it = g_sets.find(set_id);
+                auto summary = summaries.find(set_id);
+                if (it != g_sets.end() && summary != summaries.end()) {
+                    sets_list.push_back(set_summary_to_json(it->second, summary->second, now));
+                }
+            }
+            res.set_content(dump_body(sets_list), "application/json");
+            return;
+        }
+
+        for (const auto& pair : summaries) {
+            auto it = g_sets.find(pair.first);
+            if (it != g_sets.end()) {
+                sets_list.push_back(set_summary_to_json(it->second, pair.second, now)); 
             }
         }
-        res.set_content(sets_list.dump(), "application/json");
+        res.set_content(dump_body(sets_list), "application/json");
+    });
+
+    add_route(svr, "GET", "/api/sets/suggest", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        std::string user_id = authenticate_request(req);
+        if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
+        std::string prefix = req.get_param_value("prefix");
+        size_t limit = DEFAULT_SUGGEST_LIMIT;
+        if (req.has_param("limit")) {
+            try {
+                limit = std::min<size_t>(std::stoul(req.get_param_value("limit")), PrefixIndex::TOP_K);
+            } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid limit\"}", "application/json"); return; }
+        }
+
+        json sets_list = json::array();
+        for (const auto& set_id : g_suggestions.suggest(user_id, prefix, limit, unix_now())) {
+            auto it = g_sets.find(set_id);
+            if (it != g_sets.end()) sets_list.push_back(set_to_json(it->second, false));
+        }
+        json response_json = {{"prefix", prefix}, {"sets", sets_list}};
+        res.set_content(dump_body(response_json), "application/json");
     });
 
     
-    svr.Get(R"(/api/sets/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "GET", R"(/api/sets/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
         std::string user_id = authenticate_request(req);
         std::string set_id = req.matches[1];
         if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
             res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
         }
-        res.set_content(set_to_json(g_sets.at(set_id)).dump(), "application/json");
+        res.set_content(dump_body(set_to_json(g_sets.at(set_id))), "application/json");
+    });
+
+
+    add_route(svr, "GET", "/api/export", [](const httplib::Request& req, httplib::Response& res) {
+        std::string format = req.has_param("format") ? req.get_param_value("format") : "ndjson";
+        bool gzip = req.has_param("gzip") && req.get_param_value("gzip") == "1";
+
+        auto cursor = std::make_shared<ExportCursor>();
+        {
+            std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+            std::string user_id = authenticate_request(req);
+            if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
+            for (const auto& summary : g_stats.summaries(user_id, static_cast<uint32_t>(unix_now()))) {
+                cursor->set_ids.push_back(summary.first);
+            }
+        }
+
+        if (format != "ndjson" && format != "csv") {
+            res.status = 400; res.set_content("{\"error\": \"format must be ndjson or csv\"}", "application/json"); return;
+        }
+        cursor->csv = (format == "csv");
+        std::string content_type = cursor->csv ? "text/csv" : "application/x-ndjson";
+        std::string filename = "flipit-export." + format;
+
+        if (gzip && !t_batch_user_id.empty()) {
+            res.status = 400; res.set_content("{\"error\": \"gzip export is not available through /api/batch\"}", "application/json"); return;
+        }
+        if (gzip) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+            cursor->gzip.reset(new httplib::detail::gzip_compressor());
+            content_type = "application/gzip";
+            filename += ".gz";
+#else
+            res.status = 501; res.set_content("{\"error\": \"gzip export is not supported by this build\"}", "application/json"); return;
+#endif
+        }
+        res.set_header("Content-Disposition", "attachment; filename=\"" + filename + "\"");
+
+        res.set_chunked_content_provider(content_type, [cursor](size_t, httplib::DataSink& sink) {
+            std::string chunk;
+            bool more = cursor->next_chunk(chunk);
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+            if (cursor->gzip) {
+                std::string compressed;
+                bool ok = cursor->gzip->compress(chunk.data(), chunk.size(), !more,
+                    [&compressed](const char* data, size_t len) { compressed.append(data, len); return true; });
+                if (!ok) return false;
+                chunk.swap(compressed);
+            }
+#endif
+            if (!chunk.empty() && !sink.write(chunk.data(), chunk.size())) return false;
+            if (!more) sink.done();
+            return true;
+        });
     });
 
     
-    svr.Post("/api/sets", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "POST", "/api/sets", [](const httplib::Request& req, httplib::Response& res) {
+        StoreWriteLock lock;
         std::string user_id = authenticate_request(req);
         if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
         try {
-            auto req_json = json::parse(req.body);
+            auto req_json = parse_body(req.body);
             std::string title = req_json.at("title");
             
             
             std::string description = req_json.contains("description") ? req_json.at("description").get<std::string>() : "";
+            std::vector<std::string> tags;
+            if (req_json.contains("tags") && !parse_tags(req_json.at("tags"), tags)) {
+                res.status = 400; res.set_content("{\"error\": \"Invalid tags\"}", "application/json"); return;
+            }
             
             
-            FlashcardSet new_set = {generate_id(), user_id, title, description, {}}; 
+            FlashcardSet new_set = {generate_id(), user_id, title, description, {}, tags}; 
             g_sets[new_set.set_id] = new_set;
+            charge_set(new_set, 1);
+            g_stats.set_added(user_id, new_set.set_id, 0);
+            g_tags.set_added(new_set);
+            g_related.text_added(user_id, new_set.set_id, set_header_text(title, description));
+            g_suggestions.set_titled(user_id, new_set.set_id, title, unix_now());
             
             saveData(); 
 
-            res.status = 201; res.set_content(set_to_json(new_set).dump(), "application/json");
+            res.status = 201; res.set_content(dump_body(set_to_json(new_set)), "application/json");
         } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid JSON or missing title\"}", "application/json"); }
     });
 
     
-    svr.Put(R"(/api/sets/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "POST", R"(/api/sets/(\w+-\w+)/clone)", [](const httplib::Request& req, httplib::Response& res) {
+        StoreWriteLock lock;
         std::string user_id = authenticate_request(req);
         std::string set_id = req.matches[1];
         if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
             res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
         }
         try {
-            auto req_json = json::parse(req.body);
-            
-            
-            if (req_json.contains("title")) {
-                g_sets.at(set_id).title = req_json.at("title");
+            const FlashcardSet& source = g_sets.at(set_id);
+            json req_json = req.body.empty() ? json::object() : parse_body(req.body);
+            std::string title = req_json.contains("title") ? req_json.at("title").get<std::string>() : source.title + " (copy)";
+            std::string description = req_json.contains("description") ? req_json.at("description").get<std::string>() : source.description;
+
+            // Shares the source's card storage until either set is edited.
+            FlashcardSet new_set = {generate_id(), user_id, title, description, source.cards, source.tags};
+            g_sets[new_set.set_id] = new_set;
+            charge_set(new_set, 1);
+            g_tags.set_added(new_set);
+            g_stats.set_added(user_id, new_set.set_id, static_cast<uint32_t>(new_set.cards.size()));
+            g_distractors.reset(user_id);
+            g_duplicates.reset(user_id);
+            g_related.reset(user_id);
+            g_suggestions.set_titled(user_id, new_set.set_id, title, unix_now());
+
+            saveData(); 
+
+            res.status = 201; res.set_content(dump_body(set_to_json(new_set, false)), "application/json");
+        } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid JSON\"}", "application/json"); }
+    });
+
+    
+    add_route(svr, "POST", R"(/api/sets/(\w+-\w+)/quiz)", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        std::string user_id = authenticate_request(req);
+        std::string set_id = req.matches[1];
+        if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
+            res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
+        }
+        size_t count = DEFAULT_QUIZ_SIZE;
+        try {
+            json req_json = req.body.empty() ? json::object() : parse_body(req.body);
+            if (req_json.contains("count")) count = std::min<size_t>(req_json.at("count").get<size_t>(), MAX_QUIZ_SIZE);
+        } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid JSON or count\"}", "application/json"); return; }
+
+        const FlashcardSet& set = g_sets.at(set_id);
+        uint32_t day = static_cast<uint32_t>(unix_now() / SECONDS_PER_DAY);
+        auto sampler = g_quiz_samplers.get(set_id, day);
+        if (!sampler) {
+            uint64_t generation = g_quiz_samplers.generation();
+            sampler = build_quiz_sampler(set, day);
+            g_quiz_samplers.put(set_id, sampler, generation);
+        }
+
+        json cards_json = json::array();
+        for (size_t index : sample_quiz(*sampler, count)) {
+            cards_json.push_back(card_to_json(set.cards[index]));
+        }
+        res.set_content(dump_body(json{{"set_id", set_id}, {"cards", cards_json}}), "application/json");
+    });
+
+    
+    add_route(svr, "PUT", R"(/api/sets/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+        StoreWriteLock lock;
+        std::string user_id = authenticate_request(req);
+        std::string set_id = req.matches[1];
+        if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
+            res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
+        }
+        try {
+            auto req_json = parse_body(req.body);
+            FlashcardSet& set = g_sets.at(set_id);
+
+            // Everything is read and checked before the set changes, so a
+            // rejected update leaves the set and its indexes as they were.
+            std::string title = req_json.contains("title") ? req_json.at("title").get<std::string>() : set.title;
+            std::string description = req_json.contains("description") ? req_json.at("description").get<std::string>() : set.description;
+            std::vector<std::string> tags;
+            bool has_tags = req_json.contains("tags");
+            if (has_tags && !parse_tags(req_json.at("tags"), tags)) {
+                res.status = 400; res.set_content("{\"error\": \"Invalid tags\"}", "application/json"); return;
             }
-            
-            
-            if (req_json.contains("description")) {
-                g_sets.at(set_id).description = req_json.at("description");
+
+            int64_t old_bytes = set_header_bytes(set);
+            std::string old_title = set.title;
+            std::string old_header = set_header_text(set.title, set.description);
+            set.title = std::move(title);
+            set.description = std::move(description);
+            if (has_tags) {
+                std::swap(set.tags, tags);
+                g_tags.tags_changed(set, tags);
             }
+            // Only a new title re-ranks the set in suggestions; editing the
+            // description or tags does not count as using it.
+            if (set.title != old_title) {
+                g_suggestions.set_untitled(user_id, set_id, old_title);
+                g_suggestions.set_titled(user_id, set_id, set.title, unix_now());
+            }
+            std::string new_header = set_header_text(set.title, set.description);
+            if (new_header != old_header) {
+                g_related.text_removed(user_id, set_id, old_header);
+                g_related.text_added(user_id, set_id, new_header);
+            }
+            g_memory.charge(memory::SETS, user_id, set_id, set_header_bytes(set) - old_bytes);
             
             saveData(); 
 
-            res.set_content(set_to_json(g_sets.at(set_id)).dump(), "application/json");
+            res.set_content(dump_body(set_to_json(g_sets.at(set_id))), "application/json");
         } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid JSON or missing fields\"}", "application/json"); }
     });
 
     
-    svr.Delete(R"(/api/sets/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "DELETE", R"(/api/sets/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+        StoreWriteLock lock;
         std::string user_id = authenticate_request(req);
         std::string set_id = req.matches[1];
         if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
             res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
         }
+        g_suggestions.set_untitled(user_id, set_id, g_sets.at(set_id).title);
+        g_tags.set_removed(g_sets.at(set_id));
+        charge_set(g_sets.at(set_id), -1);
         g_sets.erase(set_id);
+        g_stats.set_removed(user_id, set_id);
+        g_quiz_samplers.invalidate(set_id);
+        g_distractors.reset(user_id);
+        g_duplicates.reset(user_id);
+        g_related.set_removed(user_id, set_id);
+        g_memory.forget_set(set_id);
         
         saveData(); 
 
@@ -332,25 +2676,33 @@ void setup_routes(httplib::Server& svr) {
     });
 
     
-    svr.Post(R"(/api/sets/(\w+-\w+)/cards)", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "POST", R"(/api/sets/(\w+-\w+)/cards)", [](const httplib::Request& req, httplib::Response& res) {
+        StoreWriteLock lock;
         std::string user_id = authenticate_request(req);
         std::string set_id = req.matches[1];
         if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
             res.status = 403; res.set_content("{\"error\": \"Unauthorized or Set not found\"}", "application/json"); return;
         }
         try {
-            auto req_json = json::parse(req.body);
+            auto req_json = parse_body(req.body);
             Flashcard new_card = {generate_id(), req_json.at("front"), req_json.at("back")};
             g_sets[set_id].cards.push_back(new_card);
+            g_memory.charge(memory::CARDS, user_id, set_id, card_bytes(new_card));
+            g_stats.card_added(user_id, set_id);
+            g_quiz_samplers.invalidate(set_id);
+            g_distractors.card_upserted(user_id, set_id, new_card);
+            g_duplicates.card_upserted(user_id, set_id, new_card);
+            g_related.text_added(user_id, set_id, card_text(new_card));
             
             saveData(); 
 
-            res.status = 201; res.set_content(card_to_json(new_card).dump(), "application/json");
+            res.status = 201; res.set_content(dump_body(card_to_json(new_card)), "application/json");
         } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid JSON or missing fields for card\"}", "application/json"); }
     });
 
     
-    svr.Put(R"(/api/sets/(\w+-\w+)/cards/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "PUT", R"(/api/sets/(\w+-\w+)/cards/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+        StoreWriteLock lock;
         std::string user_id = authenticate_request(req);
         std::string set_id = req.matches[1];
         std::string card_id = req.matches[2];
@@ -360,21 +2712,28 @@ void setup_routes(httplib::Server& svr) {
         }
 
         try {
-            auto req_json = json::parse(req.body);
+            auto req_json = parse_body(req.body);
             std::string new_front = req_json.at("front");
             std::string new_back = req_json.at("back");
 
             auto& cards = g_sets.at(set_id).cards;
-            auto it = std::find_if(cards.begin(), cards.end(), 
+            auto found = std::find_if(cards.begin(), cards.end(), 
                                     [&card_id](const Flashcard& c){ return c.card_id == card_id; });
 
-            if (it != cards.end()) {
-                it->front = new_front;
-                it->back = new_back;
+            if (found != cards.end()) {
+                size_t index = found - cards.begin();
+                g_related.text_removed(user_id, set_id, card_text(*found));
+                int64_t old_bytes = cards.bytes();
+                cards.set_text(index, new_front, new_back);
+                const Flashcard& card = cards[index];
+                g_memory.charge(memory::CARDS, user_id, set_id, cards.bytes() - old_bytes);
+                g_related.text_added(user_id, set_id, card_text(card));
+                g_distractors.card_upserted(user_id, set_id, card);
+                g_duplicates.card_upserted(user_id, set_id, card);
                 
                 saveData(); 
 
-                res.set_content(card_to_json(*it).dump(), "application/json");
+                res.set_content(dump_body(card_to_json(card)), "application/json");
             } else {
                 res.status = 404; res.set_content("{\"error\": \"Card not found\"}", "application/json");
             }
@@ -382,7 +2741,8 @@ void setup_routes(httplib::Server& svr) {
     });
 
     
-    svr.Delete(R"(/api/sets/(\w+-\w+)/cards/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+    add_route(svr, "DELETE", R"(/api/sets/(\w+-\w+)/cards/(\w+-\w+))", [](const httplib::Request& req, httplib::Response& res) {
+        StoreWriteLock lock;
         std::string user_id = authenticate_request(req);
         std::string set_id = req.matches[1];
         std::string card_id = req.matches[2];
@@ -392,13 +2752,20 @@ void setup_routes(httplib::Server& svr) {
         }
 
         auto& cards = g_sets.at(set_id).cards;
-        size_t old_size = cards.size();
+        auto found = std::find_if(cards.begin(), cards.end(),
+                                  [&card_id](const Flashcard& c){ return c.card_id == card_id; });
+
+        if (found != cards.end()) {
+            size_t index = found - cards.begin();
+            g_related.text_removed(user_id, set_id, card_text(*found));
+            int64_t old_bytes = cards.bytes();
+            cards.erase(index);
+            g_memory.charge(memory::CARDS, user_id, set_id, cards.bytes() - old_bytes);
+            g_stats.card_removed(user_id, set_id, card_id);
+            g_quiz_samplers.invalidate(set_id);
+            g_distractors.card_removed(user_id, set_id, card_id);
+            g_duplicates.card_removed(user_id, set_id, card_id);
 
-        cards.erase(std::remove_if(cards.begin(), cards.end(),
-                                   [&card_id](const Flashcard& c){ return c.card_id == card_id; }),
-                            cards.end());
-
-        if (cards.size() < old_size) {
             saveData(); 
 
             res.set_content("{\"message\": \"Card deleted\"}", "application/json");
@@ -407,11 +2774,381 @@ void setup_routes(httplib::Server& svr) {
         }
     });
 
-    svr.Post("/api/stats", [](const httplib::Request& req, httplib::Response& res) { 
-        res.status = 501; 
-        res.set_content("{\"error\": \"Stats route is not yet implemented\"}", "application/json");
+    add_route(svr, "GET", R"(/api/sets/(\w+-\w+)/cards/(\w+-\w+)/choices)", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        std::string user_id = authenticate_request(req);
+        std::string set_id = req.matches[1];
+        std::string card_id = req.matches[2];
+        if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
+            res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
+        }
+        size_t count = DEFAULT_CHOICE_COUNT;
+        if (req.has_param("count")) {
+            try {
+                count = std::min<size_t>(std::stoul(req.get_param_value("count")), MAX_CHOICE_COUNT);
+            } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid count\"}", "application/json"); return; }
+        }
+
+        const auto& cards = g_sets.at(set_id).cards;
+        auto found = std::find_if(cards.begin(), cards.end(),
+                                  [&card_id](const Flashcard& c){ return c.card_id == card_id; });
+        if (found == cards.end()) {
+            res.status = 404; res.set_content("{\"error\": \"Card not found\"}", "application/json"); return;
+        }
+
+        json choices = json::array();
+        for (const auto& entry : g_distractors.choices(user_id, set_id, card_id, count, unix_now())) {
+            choices.push_back({{"set_id", entry.group},
+                               {"card_id", entry.key.substr(entry.key.find('/') + 1)},
+                               {"back", entry.text}});
+        }
+        json response_json = {{"card_id", card_id}, {"back", found->back}, {"choices", choices}};
+        res.set_content(dump_body(response_json), "application/json");
+    });
+
+    add_route(svr, "GET", R"(/api/sets/(\w+-\w+)/duplicates)", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        std::string user_id = authenticate_request(req);
+        std::string set_id = req.matches[1];
+        if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
+            res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
+        }
+        int max_distance;
+        size_t limit;
+        if (!parse_duplicate_params(req, max_distance, limit)) {
+            res.status = 400; res.set_content("{\"error\": \"Invalid max_distance or limit\"}", "application/json"); return;
+        }
+        std::vector<CardDuplicate> duplicates;
+        bool ready = g_duplicates.find(user_id, set_id, max_distance, limit, unix_now(), duplicates);
+        if (!ready) { res.status = 202; res.set_header("Retry-After", "1"); }
+        json response_json = {{"set_id", set_id}, {"max_distance", max_distance}, {"building", !ready},
+                              {"duplicates", duplicates_to_json(duplicates)}};
+        res.set_content(dump_body(response_json), "application/json");
+    });
+
+    add_route(svr, "GET", R"(/api/sets/(\w+-\w+)/related)", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        std::string user_id = authenticate_request(req);
+        std::string set_id = req.matches[1];
+        if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
+            res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
+        }
+        size_t limit = DEFAULT_RELATED_LIMIT;
+        if (req.has_param("limit")) {
+            try {
+                limit = std::min<size_t>(std::stoul(req.get_param_value("limit")), MAX_RELATED_LIMIT);
+            } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid limit\"}", "application/json"); return; }
+        }
+
+        json related = json::array();
+        for (const auto& match : g_related.related(user_id, set_id, limit, unix_now())) {
+            auto set = g_sets.find(match.doc);
+            if (set == g_sets.end()) continue;
+            json entry = set_to_json(set->second, false);
+            entry["similarity"] = match.similarity;
+            related.push_back(entry);
+        }
+        json response_json = {{"set_id", set_id}, {"related", related}};
+        res.set_content(dump_body(response_json), "application/json");
+    });
+
+    add_route(svr, "GET", "/api/duplicates", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        std::string user_id = authenticate_request(req);
+        if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
+        int max_distance;
+        size_t limit;
+        if (!parse_duplicate_params(req, max_distance, limit)) {
+            res.status = 400; res.set_content("{\"error\": \"Invalid max_distance or limit\"}", "application/json"); return;
+        }
+        std::vector<CardDuplicate> duplicates;
+        bool ready = g_duplicates.find(user_id, "", max_distance, limit, unix_now(), duplicates);
+        if (!ready) { res.status = 202; res.set_header("Retry-After", "1"); }
+        json response_json = {{"max_distance", max_distance}, {"building", !ready}, {"duplicates", duplicates_to_json(duplicates)}};
+        res.set_content(dump_body(response_json), "application/json");
+    });
+
+    add_route(svr, "POST", "/api/stats", [](const httplib::Request& req, httplib::Response& res) { 
+        std::string set_id;
+        std::vector<QuizResult> results;
+        try {
+            auto req_json = parse_body(req.body);
+            set_id = req_json.at("set_id");
+            for (const auto& item : req_json.at("results")) {
+                QuizResult result;
+                result.card_id = item.at("card_id");
+                result.correct = item.at("correct");
+                if (item.contains("grade")) result.grade = item.at("grade");
+                if (item.contains("latency_ms")) result.latency_ms = item.at("latency_ms");
+                results.push_back(result);
+            }
+        } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid JSON or missing set_id/results\"}", "application/json"); return; }
+        if (results.size() > MAX_QUIZ_RESULTS_PER_REQUEST) {
+            res.status = 413; res.set_content("{\"error\": \"Too many results in one request\"}", "application/json"); return;
+        }
+
+        std::string user_id;
+        {
+            std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+            user_id = authenticate_request(req);
+            if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
+                res.status = 403; res.set_content("{\"error\": \"Unauthorized or Set not found\"}", "application/json"); return;
+            }
+            std::unordered_set<std::string> card_ids;
+            for (const auto& card : g_sets.at(set_id).cards) card_ids.insert(card.card_id);
+            results.erase(std::remove_if(results.begin(), results.end(),
+                                         [&card_ids](const QuizResult& r){ return !card_ids.count(r.card_id); }),
+                          results.end());
+            if (!results.empty()) g_suggestions.touched(user_id, set_id, g_sets.at(set_id).title, unix_now());
+        }
+
+        // Persisted by maintenance_loop() rather than a saveData() per quiz.
+        g_stats.record(user_id, set_id, results, static_cast<uint32_t>(unix_now()));
+        g_quiz_samplers.invalidate(set_id);
+
+        uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        for (const auto& result : results) {
+            g_events.append({user_id, StatsStore::card_key(set_id, result.card_id), now_ms, result.correct, result.latency_ms});
+        }
+
+        json response_json = {{"message", "Stats recorded"}, {"recorded", results.size()}};
+        res.set_content(dump_body(response_json), "application/json");
+    });
+
+    
+    add_route(svr, "GET", R"(/api/sets/(\w+-\w+)/stats)", [](const httplib::Request& req, httplib::Response& res) {
+        std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+        std::string user_id = authenticate_request(req);
+        std::string set_id = req.matches[1];
+        if (user_id.empty() || !g_sets.count(set_id) || g_sets.at(set_id).user_id != user_id) {
+            res.status = 404; res.set_content("{\"error\": \"Set not found or unauthorized\"}", "application/json"); return;
+        }
+
+        std::vector<std::string> card_ids;
+        for (const auto& card : g_sets.at(set_id).cards) card_ids.push_back(card.card_id);
+        std::vector<CardStat> stats = g_stats.lookup(user_id, set_id, card_ids);
+
+        json cards_json = json::array();
+        for (size_t i = 0; i < card_ids.size(); i++) {
+            cards_json.push_back({
+                {"card_id", card_ids[i]},
+                {"attempts", stats[i].attempts},
+                {"correct", stats[i].correct},
+                {"last_seen", stats[i].last_seen},
+                {"streak", stats[i].streak},
+                {"due", stats[i].due},
+                {"interval", stats[i].interval}
+            });
+        }
+        res.set_content(dump_body(json{{"set_id", set_id}, {"cards", cards_json}}), "application/json");
+    });
+    
+    add_route(svr, "GET", "/api/stats/history", [](const httplib::Request& req, httplib::Response& res) {
+        std::string user_id;
+        {
+            std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+            user_id = authenticate_request(req);
+        }
+        if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
+
+        std::string granularity = req.has_param("granularity") ? req.get_param_value("granularity") : "day";
+        if (granularity != "day" && granularity != "minute") {
+            res.status = 400; res.set_content("{\"error\": \"granularity must be day or minute\"}", "application/json"); return;
+        }
+        int64_t now = unix_now();
+        int64_t from, to;
+        try {
+            from = req.has_param("from") ? std::stoll(req.get_param_value("from")) : now - 30 * 24 * 60 * 60;
+            to = req.has_param("to") ? std::stoll(req.get_param_value("to")) : now;
+        } catch (...) { res.status = 400; res.set_content("{\"error\": \"from and to must be unix timestamps\"}", "application/json"); return; }
+
+        json history = json::array();
+        for (const auto& bucket : g_events.history(user_id, granularity == "day", from, to)) {
+            const eventlog::Rollup& r = bucket.second;
+            history.push_back({
+                {"t", bucket.first},
+                {"attempts", r.attempts},
+                {"correct", r.correct},
+                {"avg_latency_ms", r.attempts ? r.latency_ms_sum / r.attempts : 0}
+            });
+        }
+        res.set_content(dump_body(history), "application/json");
     });
+
     
+    add_route(svr, "GET", "/api/review/due", [](const httplib::Request& req, httplib::Response& res) {
+        std::string user_id;
+        {
+            std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+            user_id = authenticate_request(req);
+        }
+        if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
+
+        size_t limit = DEFAULT_REVIEW_LIMIT;
+        if (req.has_param("limit")) {
+            try {
+                limit = std::min<size_t>(std::stoul(req.get_param_value("limit")), MAX_REVIEW_LIMIT);
+            } catch (...) { res.status = 400; res.set_content("{\"error\": \"limit must be a number\"}", "application/json"); return; }
+        }
+
+        json due_json = json::array();
+        for (const auto& card : g_stats.due(user_id, static_cast<uint32_t>(unix_now()), limit)) {
+            due_json.push_back({
+                {"set_id", card.set_id},
+                {"card_id", card.card_id},
+                {"due", card.stat.due},
+                {"interval", card.stat.interval},
+                {"ease", card.stat.ease / 1000.0}
+            });
+        }
+        res.set_content(dump_body(due_json), "application/json");
+    });
+
+    svr.Post("/api/batch", [](const httplib::Request& req, httplib::Response& res) {
+        std::string user_id;
+        {
+            std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+            user_id = authenticate_request(req);
+        }
+        if (user_id.empty()) { res.status = 403; res.set_content("{\"error\": \"Authentication required\"}", "application/json"); return; }
+
+        json requests;
+        try {
+            requests = parse_body(req.body).at("requests");
+        } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid JSON or missing requests\"}", "application/json"); return; }
+        if (!requests.is_array() || requests.size() > MAX_BATCH_REQUESTS) {
+            res.status = 400; res.set_content("{\"error\": \"requests must be an array of at most " + std::to_string(MAX_BATCH_REQUESTS) + " entries\"}", "application/json"); return;
+        }
+
+        json responses = json::array();
+        {
+            BatchScope scope(user_id);
+            for (const auto& sub : requests) {
+                try {
+                    responses.push_back(run_batch_request(req, sub));
+                } catch (...) {
+                    responses.push_back(json{{"status", 400}, {"body", {{"error", "Sub-request needs method and path"}}}});
+                }
+            }
+        }
+
+        res.set_content(dump_body(responses), "application/json");
+    });
+
+    // Prometheus scrape target; registered directly so it stays out of /api/batch.
+    svr.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+        std::ostringstream out;
+        g_request_latency.render(out);
+        g_persistence_latency.render(out);
+        out << "# HELP flipit_http_requests_in_flight Requests currently being handled.\n"
+            << "# TYPE flipit_http_requests_in_flight gauge\n"
+            << "flipit_http_requests_in_flight " << g_requests_in_flight.load() << "\n";
+        out << "# HELP flipit_admission_queue_depth Connections waiting for a worker.\n"
+            << "# TYPE flipit_admission_queue_depth gauge\n"
+            << "flipit_admission_queue_depth " << g_admission.queued.load() << "\n";
+        out << "# HELP flipit_admission_admitted_total Connections handed to a worker.\n"
+            << "# TYPE flipit_admission_admitted_total counter\n"
+            << "flipit_admission_admitted_total " << g_admission.admitted.load() << "\n";
+        out << "# HELP flipit_admission_shed_total Connections answered with 503, by reason.\n"
+            << "# TYPE flipit_admission_shed_total counter\n"
+            << "flipit_admission_shed_total{reason=\"queue_full\"} " << g_admission.shed_queue_full.load() << "\n"
+            << "flipit_admission_shed_total{reason=\"queue_delay\"} " << g_admission.shed_queue_delay.load() << "\n";
+        out << "# HELP flipit_admission_dropped_total Connections closed unanswered because the rejecters were backed up.\n"
+            << "# TYPE flipit_admission_dropped_total counter\n"
+            << "flipit_admission_dropped_total " << g_admission.dropped.load() << "\n";
+        g_admission_delay.render(out);
+        out << "# HELP flipit_lane_running Requests holding a run slot, by lane.\n"
+            << "# TYPE flipit_lane_running gauge\n";
+        std::ostringstream waiting, admitted, refused;
+        for (int l = 0; l < lanes::LANES; l++) {
+            lanes::Lane lane = static_cast<lanes::Lane>(l);
+            lanes::LaneScheduler::LaneStats stats = g_lanes.stats(lane);
+            std::string label = std::string("lane=\"") + lanes::lane_name(lane) + "\"";
+            out << "flipit_lane_running{" << label << "} " << stats.running << "\n";
+            waiting << "flipit_lane_waiting{" << label << "} " << stats.waiting << "\n";
+            admitted << "flipit_lane_admitted_total{" << label << "} " << stats.admitted << "\n";
+            refused << "flipit_lane_refused_total{" << label << ",reason=\"queue_full\"} " << stats.queue_full << "\n"
+                    << "flipit_lane_refused_total{" << label << ",reason=\"timeout\"} " << stats.timed_out << "\n";
+        }
+        out << "# HELP flipit_lane_waiting Requests waiting for a run slot, by lane.\n"
+            << "# TYPE flipit_lane_waiting gauge\n" << waiting.str();
+        out << "# HELP flipit_lane_admitted_total Requests given a run slot, by lane.\n"
+            << "# TYPE flipit_lane_admitted_total counter\n" << admitted.str();
+        out << "# HELP flipit_lane_refused_total Requests answered with 503 without running, by lane and reason.\n"
+            << "# TYPE flipit_lane_refused_total counter\n" << refused.str();
+        g_lane_wait.render(out);
+        out << "# HELP flipit_kdf_queue_depth Password hashing jobs waiting for a worker.\n"
+            << "# TYPE flipit_kdf_queue_depth gauge\n"
+            << "flipit_kdf_queue_depth " << g_kdf_pool->queued() << "\n";
+        res.set_content(out.str(), "text/plain; version=0.0.4");
+    });
+
+    // Samples every thread for ?seconds=N and returns folded stacks for
+    // flamegraph.pl or speedscope. Holds this worker for the duration.
+    svr.Get("/debug/profile", [](const httplib::Request& req, httplib::Response& res) {
+        if (!is_admin_request(req)) { res.status = 403; res.set_content("{\"error\": \"Admin token required\"}", "application/json"); return; }
+        int seconds = DEFAULT_PROFILE_SECONDS;
+        int hz = DEFAULT_PROFILE_HZ;
+        try {
+            if (req.has_param("seconds")) seconds = std::stoi(req.get_param_value("seconds"));
+            if (req.has_param("hz")) hz = std::stoi(req.get_param_value("hz"));
+        } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid seconds or hz\"}", "application/json"); return; }
+        if (seconds < 1 || seconds > MAX_PROFILE_SECONDS || hz < 1 || hz > MAX_PROFILE_HZ) {
+            res.status = 400; res.set_content("{\"error\": \"seconds must be 1-" + std::to_string(MAX_PROFILE_SECONDS) + " and hz 1-" + std::to_string(MAX_PROFILE_HZ) + "\"}", "application/json"); return;
+        }
+
+        profiler::SamplingProfiler::Result result;
+        if (!profiler::SamplingProfiler::instance().run(std::chrono::seconds(seconds), hz, result)) {
+            res.status = 409; res.set_content("{\"error\": \"A profile is already running\"}", "application/json"); return;
+        }
+        logging::info("profile_taken").num("seconds", seconds).num("hz", hz).num("samples", result.samples).num("dropped", result.dropped);
+        res.set_header("X-Profile-Samples", std::to_string(result.samples));
+        res.set_content(result.folded, "text/plain");
+    });
+
+    // Estimated memory by subsystem, plus the ?limit=N (default 10) largest
+    // users and sets, read from g_memory's running totals.
+    svr.Get("/admin/memory", [](const httplib::Request& req, httplib::Response& res) {
+        if (!is_admin_request(req)) { res.status = 403; res.set_content("{\"error\": \"Admin token required\"}", "application/json"); return; }
+        size_t limit = DEFAULT_MEMORY_TOP;
+        if (req.has_param("limit")) {
+            try {
+                limit = std::min<size_t>(std::stoul(req.get_param_value("limit")), MAX_MEMORY_TOP);
+            } catch (...) { res.status = 400; res.set_content("{\"error\": \"Invalid limit\"}", "application/json"); return; }
+        }
+
+        memory::Ledger::Report report = g_memory.report(limit);
+        json subsystems = json::object();
+        int64_t total = 0;
+        for (int s = 0; s < memory::SUBSYSTEMS; s++) {
+            subsystems[memory::subsystem_name(static_cast<memory::Subsystem>(s))] = report.totals[s];
+            total += report.totals[s];
+        }
+        json users = json::array();
+        json sets = json::array();
+        {
+            std::shared_lock<std::shared_mutex> lock(g_store_mutex);
+            for (const auto& entry : report.top_users) {
+                auto user = g_users.find(entry.first);
+                users.push_back({{"user_id", entry.first}, {"username", user == g_users.end() ? "" : user->second.username},
+                                 {"bytes", entry.second}});
+            }
+            for (const auto& entry : report.top_sets) {
+                auto set = g_sets.find(entry.first);
+                json row = {{"set_id", entry.first}, {"bytes", entry.second}};
+                if (set != g_sets.end()) {
+                    row["user_id"] = set->second.user_id;
+                    row["title"] = set->second.title;
+                    row["card_count"] = set->second.cards.size();
+                }
+                sets.push_back(row);
+            }
+        }
+        json response_json = {{"total_bytes", total}, {"subsystems", subsystems}, {"top_users", users}, {"top_sets", sets}};
+        res.set_content(dump_body(response_json), "application/json");
+    });
+
     svr.Options(R"(/.*)", [](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Methods", "GET, POST, PUT, DELETE, OPTIONS");
@@ -420,26 +3157,141 @@ void setup_routes(httplib::Server& svr) {
     });
 }
 
+// Defined by builds that link this file into another program, such as the
+// benchmarks in bench/.
+#ifndef FLIPIT_NO_MAIN
 int main() {
     std::srand(static_cast<unsigned int>(std::time(nullptr)));
+    logging::start();
+    g_access_log = env_or("FLIPIT_ACCESS_LOG", 1) != 0;
+    if (const char* token = std::getenv("FLIPIT_ADMIN_TOKEN")) g_admin_token = token;
+
+    tracing::Options trace_options;
+    if (const char* file = std::getenv("FLIPIT_TRACE_FILE")) trace_options.file = file;
+    trace_options.sample_every = env_or("FLIPIT_TRACE_SAMPLE", trace_options.sample_every);
+    trace_options.slow_us = env_or("FLIPIT_TRACE_SLOW_MS", trace_options.slow_us / 1000) * 1000;
+    g_tracer.configure(trace_options);
+
+    size_t kdf_log2_n = env_or("FLIPIT_KDF_LOG2_N", g_kdf_params.log2_n);
+    size_t kdf_r = env_or("FLIPIT_KDF_R", g_kdf_params.r);
+    size_t kdf_p = env_or("FLIPIT_KDF_P", g_kdf_params.p);
+    if (!KdfParams::valid(kdf_log2_n, kdf_r, kdf_p)) {
+        logging::error("kdf_params_invalid").num("log2_n", kdf_log2_n).num("r", kdf_r).num("p", kdf_p)
+            .num("max_log2_n", KdfParams::MAX_LOG2_N).num("max_r", KdfParams::MAX_R).num("max_p", KdfParams::MAX_P)
+            .num("max_bytes", KdfParams::MAX_BYTES);
+        logging::shutdown();
+        return 1;
+    }
+    g_kdf_params.log2_n = static_cast<int>(kdf_log2_n);
+    g_kdf_params.r = static_cast<uint32_t>(kdf_r);
+    g_kdf_params.p = static_cast<uint32_t>(kdf_p);
+    size_t kdf_threads = env_or("FLIPIT_KDF_THREADS", std::max(1u, std::thread::hardware_concurrency() / 2));
+    g_kdf_pool.reset(new BoundedWorkerPool(kdf_threads, env_or("FLIPIT_KDF_QUEUE", 64)));
 
     loadData(); 
+    g_sessions.load();
+    g_events.load();
+    std::thread(maintenance_loop).detach();
+    std::thread([] { g_duplicates.run(); }).detach();
 
     httplib::Server svr;
     
     setup_routes(svr);
 
+    admission::Options admission_options;
+    admission_options.threads = env_or("FLIPIT_WORKERS", admission_options.threads);
+    admission_options.max_queue = env_or("FLIPIT_ADMISSION_QUEUE", admission_options.max_queue);
+    admission_options.reject_threads = env_or("FLIPIT_ADMISSION_REJECTERS", admission_options.reject_threads);
+    admission_options.reject_deadline = std::chrono::milliseconds(env_or("FLIPIT_ADMISSION_REJECT_DEADLINE_MS", admission_options.reject_deadline.count()));
+    admission_options.target = std::chrono::milliseconds(env_or("FLIPIT_ADMISSION_TARGET_MS", admission_options.target.count()));
+    admission_options.interval = std::chrono::milliseconds(env_or("FLIPIT_ADMISSION_INTERVAL_MS", admission_options.interval.count()));
+    admission_options.queue_delay = &g_admission_delay;
+    svr.new_task_queue = [admission_options] { return new admission::AdmissionQueue(admission_options, g_admission); };
+
+    // Requests waiting for a slot hold an httplib worker, so the write and
+    // expensive lanes' running plus waiting budgets are kept well under the
+    // worker count, leaving workers for reads however those lanes back up.
+    // Slots default to half the workers: handlers also block on disk and
+    // the KDF pool, so a core count would leave small hosts idle. Setting
+    // FLIPIT_LANE_SLOTS to the core count caps CPU-bound deployments instead.
+    lanes::Options lane_options;
+    lane_options.slots = env_or("FLIPIT_LANE_SLOTS", std::max<size_t>(2, admission_options.threads / 2));
+    lane_options.max_wait = std::chrono::milliseconds(env_or("FLIPIT_LANE_WAIT_MS", lane_options.max_wait.count()));
+    lane_options.lanes[lanes::READ] = {lane_options.slots, admission_options.threads};
+    lane_options.lanes[lanes::WRITE] = {std::max<size_t>(1, lane_options.slots / 2), std::max<size_t>(1, admission_options.threads / 4)};
+    // Expensive requests are mostly logins and registrations waiting on the
+    // KDF pool, so the lane may run as many as that pool has threads.
+    lane_options.lanes[lanes::EXPENSIVE] = {std::max<size_t>(1, std::min(kdf_threads, lane_options.slots / 2)),
+                                            std::max<size_t>(1, admission_options.threads / 4)};
+    for (int l = 0; l < lanes::LANES; l++) {
+        std::string prefix = "FLIPIT_LANE_" + std::string(lanes::lane_name(static_cast<lanes::Lane>(l)));
+        std::transform(prefix.begin(), prefix.end(), prefix.begin(), ::toupper);
+        lanes::LaneOptions& lane = lane_options.lanes[l];
+        lane.budget = env_or((prefix + "_BUDGET").c_str(), lane.budget);
+        lane.max_waiting = env_or((prefix + "_QUEUE").c_str(), lane.max_waiting);
+    }
+    g_lanes.configure(lane_options);
+
+    svr.set_pre_routing_handler([](const httplib::Request& req, httplib::Response& res) {
+        // Connections the admission queue shed get a cheap 503 and are
+        // closed; they never reach a handler or the request metrics.
+        if (admission::shedding()) {
+            respond_busy_and_close(res, "Server overloaded, please retry");
+            return httplib::Server::HandlerResponse::Handled;
+        }
+        t_request_started = std::chrono::steady_clock::now();
+        t_request_active = true;
+        g_requests_in_flight++;
+        std::string trace_id = tracing::Tracer::trace_id(req.get_header_value("X-Trace-Id"));
+        res.set_header("X-Trace-Id", trace_id);
+        res.set_header("Access-Control-Expose-Headers", "X-Trace-Id");
+        g_tracer.begin_request(std::move(trace_id));
+
+        lanes::Lane lane;
+        if (classify_lane(req, lane)) {
+            tracing::Span span("lane_wait");
+            auto wait_started = std::chrono::steady_clock::now();
+            lanes::LaneScheduler::Outcome outcome = g_lanes.acquire(lane);
+            auto waited = std::chrono::steady_clock::now() - wait_started;
+            g_lane_wait.record(std::string("lane=\"") + lanes::lane_name(lane) + "\"",
+                               std::chrono::duration_cast<std::chrono::microseconds>(waited).count());
+            if (outcome != lanes::LaneScheduler::ADMITTED) {
+                // The request body is still unread, so the connection
+                // cannot be reused.
+                respond_busy_and_close(res, "Server busy, please retry");
+                return httplib::Server::HandlerResponse::Handled;
+            }
+            t_request_lane = lane;
+        }
+        g_tracer.pre_routing_done();
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+
     svr.set_post_routing_handler([](const httplib::Request& req, httplib::Response& res) {
         if (res.get_header_value("Access-Control-Allow-Origin").empty()) {
             res.set_header("Access-Control-Allow-Origin", "*");
         }
+        // Post-routing runs once the handler has returned (before a streamed
+        // body is written), so the slot covers exactly the handler.
+        if (t_request_lane != lanes::LANES) {
+            g_lanes.release(t_request_lane);
+            t_request_lane = lanes::LANES;
+        }
+        // Requests httplib rejects before routing never passed pre-routing.
+        if (t_request_active) {
+            t_request_active = false;
+            g_requests_in_flight--;
+            finish_request(req, res);
+        }
     });
 
-    std::cout << "Starting FLIPIT! C++ Backend on https://fae19d40-ad8e-4df9-84a1-f4f2d63120cc-00-3rs2mxgv72489.sisko.replit.dev/api" << std::endl;
+    logging::info("server_starting").str("url", "https://fae19d40-ad8e-4df9-84a1-f4f2d63120cc-00-3rs2mxgv72489.sisko.replit.dev/api").num("port", 8080);
     if (!svr.listen("0.0.0.0", 8080)) {
-        std::cerr << "Failed to start server." << std::endl;
+        logging::error("server_start_failed").num("port", 8080);
     }
+    logging::shutdown();
 
 
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+
+// 64-bit SimHash fingerprints with a multi-index table for Hamming search.
+// The fingerprint is split into BLOCKS 8-bit blocks and each entry is
+// indexed under every block, so by pigeonhole any two fingerprints within
+// MAX_DISTANCE bits of each other agree exactly on at least one block.
+// Card text is short, so near-duplicates sit further apart than the usual
+// 3 bits for web pages; eight blocks keep the search exact up to 7.
+//
+// With 8-bit blocks a bucket holds about 1/256 of the entries, too many to
+// probe for every entry on every query. Instead each upsert probes only the
+// new entry's buckets and records the pairs it forms, so the index always
+// holds every pair within MAX_DISTANCE, ordered closest first, and a query
+// just walks them. build() loads a whole library at once, probing every
+// entry exactly once with the work split across threads.
+class SimHashIndex {
+public:
+    static const int BLOCKS = 8;
+    static const int BLOCK_BITS = 64 / BLOCKS;
+    static const int MAX_DISTANCE = BLOCKS - 1;
+
+    struct Entry {
+        std::string key;
+        std::string group;
+        uint64_t fingerprint;
+        std::vector<std::string> neighbours; // keys within MAX_DISTANCE
+    };
+
+    struct Pair {
+        const Entry* a;
+        const Entry* b;
+        int distance;
+    };
+
+    // Fingerprint over character trigrams of each field, normalised to
+    // lowercase alphanumerics separated by single spaces. Fields are salted
+    // by position so front/back swaps do not collide.
+    static uint64_t fingerprint(const std::vector<std::string>& fields) {
+        std::array<int32_t, 64> votes{};
+        for (size_t f = 0; f < fields.size(); f++) {
+            std::string text = normalize(fields[f]);
+            size_t shingle = std::min<size_t>(3, text.size());
+            for (size_t i = 0; i + shingle <= text.size(); i++) {
+                uint64_t h = mix(fnv1a(text.data() + i, shingle) + f);
+                for (int bit = 0; bit < 64; bit++) {
+                    votes[bit] += (h >> bit) & 1 ? 1 : -1;
+                }
+            }
+        }
+        uint64_t out = 0;
+        for (int bit = 0; bit < 64; bit++) {
+            if (votes[bit] > 0) out |= uint64_t(1) << bit;
+        }
+        return out;
+    }
+
+    static int distance(uint64_t a, uint64_t b) { return __builtin_popcountll(a ^ b); }
+
+    // Runs fn(begin, end) over [0, n) split across up to `threads` threads.
+    template <typename Fn>
+    static void parallel_for(size_t n, size_t threads, Fn fn) {
+        size_t workers = std::max<size_t>(1, std::min(threads, n / 256));
+        if (workers == 1) {
+            fn(size_t(0), n);
+            return;
+        }
+        std::vector<std::future<void>> parts;
+        size_t step = (n + workers - 1) / workers;
+        for (size_t begin = 0; begin < n; begin += step) {
+            parts.push_back(std::async(std::launch::async, fn, begin, std::min(n, begin + step)));
+        }
+        for (auto& part : parts) part.get();
+    }
+
+    // An index over entries (fingerprints filled in, keys unique). All
+    // entries go into the tables first, then each one is probed once in
+    // parallel, keeping a pair only from its lower key.
+    static SimHashIndex build(std::vector<Entry> entries, size_t threads) {
+        SimHashIndex index;
+        index.entries_ = std::move(entries);
+        index.positions_.reserve(index.entries_.size());
+        for (size_t i = 0; i < index.entries_.size(); i++) {
+            const Entry& e = index.entries_[i];
+            index.positions_[e.key] = i;
+            index.bytes_ += entry_bytes(e);
+            for (int b = 0; b < BLOCKS; b++) {
+                index.tables_[b][block(e.fingerprint, b)].push_back(e.key);
+            }
+        }
+
+        std::vector<PairKey> found;
+        std::mutex merge;
+        parallel_for(index.entries_.size(), threads, [&](size_t begin, size_t end) {
+            std::vector<PairKey> local;
+            for (size_t i = begin; i < end; i++) {
+                const Entry& e = index.entries_[i];
+                index.probe(e, MAX_DISTANCE, [&](const Entry& other, int d) {
+                    if (e.key < other.key) local.push_back({d, e.key, other.key});
+                });
+            }
+            std::lock_guard<std::mutex> lock(merge);
+            std::move(local.begin(), local.end(), std::back_inserter(found));
+        });
+        for (auto& pair : found) {
+            index.entries_[index.positions_.at(pair.low)].neighbours.push_back(pair.high);
+            index.entries_[index.positions_.at(pair.high)].neighbours.push_back(pair.low);
+            index.bytes_ += pair_bytes(pair);
+            index.pairs_.insert(std::move(pair));
+        }
+        return index;
+    }
+
+    size_t size() const { return entries_.size(); }
+
+    // Estimated heap footprint, kept current by upsert() and remove().
+    size_t memory_bytes() const { return bytes_; }
+
+    void upsert(const std::string& key, const std::string& group, uint64_t fingerprint) {
+        auto pos = positions_.find(key);
+        if (pos != positions_.end() && entries_[pos->second].fingerprint == fingerprint &&
+            entries_[pos->second].group == group) {
+            return;
+        }
+        remove(key);
+        positions_[key] = entries_.size();
+        entries_.push_back({key, group, fingerprint, {}});
+        bytes_ += entry_bytes(entries_.back());
+        for (int b = 0; b < BLOCKS; b++) {
+            tables_[b][block(fingerprint, b)].push_back(key);
+        }
+
+        std::vector<std::pair<size_t, int>> found;
+        probe(entries_.back(), MAX_DISTANCE, [&](const Entry& other, int d) {
+            found.emplace_back(positions_.at(other.key), d);
+        });
+        for (const auto& f : found) {
+            Entry& other = entries_[f.first];
+            other.neighbours.push_back(key);
+            entries_.back().neighbours.push_back(other.key);
+            auto inserted = pairs_.insert(pair_key(key, other.key, f.second));
+            bytes_ += pair_bytes(*inserted.first);
+        }
+    }
+
+    void remove(const std::string& key) {
+        auto pos = positions_.find(key);
+        if (pos == positions_.end()) {
+            return;
+        }
+        size_t index = pos->second;
+        for (const auto& n : entries_[index].neighbours) {
+            Entry& other = entries_[positions_.at(n)];
+            auto pair = pairs_.find(pair_key(key, n, distance(entries_[index].fingerprint, other.fingerprint)));
+            if (pair != pairs_.end()) {
+                bytes_ -= pair_bytes(*pair);
+                pairs_.erase(pair);
+            }
+            other.neighbours.erase(std::remove(other.neighbours.begin(), other.neighbours.end(), key), other.neighbours.end());
+        }
+        bytes_ -= entry_bytes(entries_[index]);
+        for (int b = 0; b < BLOCKS; b++) {
+            auto bucket = tables_[b].find(block(entries_[index].fingerprint, b));
+            if (bucket == tables_[b].end()) continue;
+            auto& keys = bucket->second;
+            keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+            if (keys.empty()) tables_[b].erase(bucket);
+        }
+        positions_.erase(pos);
+        if (index + 1 != entries_.size()) {
+            entries_[index] = std::move(entries_.back());
+            positions_[entries_[index].key] = index;
+        }
+        entries_.pop_back();
+    }
+
+    // Up to limit pairs within max_distance bits where at least one entry
+    // satisfies pred, closest first. That entry is reported as a, or the one
+    // with the lower key when both do. The pointers are valid until the
+    // index next changes.
+    template <typename Pred>
+    std::vector<Pair> pairs(int max_distance, size_t limit, Pred pred) const {
+        std::vector<Pair> out;
+        for (const auto& p : pairs_) {
+            if (p.distance > max_distance) break;
+            // Ties at the last distance taken are all collected so the sort
+            // below picks the same ones whatever the set order.
+            if (out.size() >= limit && (out.empty() || p.distance != out.back().distance)) break;
+            const Entry& low = entries_[positions_.at(p.low)];
+            const Entry& high = entries_[positions_.at(p.high)];
+            if (pred(low)) {
+                out.push_back({&low, &high, p.distance});
+            } else if (pred(high)) {
+                out.push_back({&high, &low, p.distance});
+            }
+        }
+        std::sort(out.begin(), out.end(), [](const Pair& x, const Pair& y) {
+            if (x.distance != y.distance) return x.distance < y.distance;
+            return x.a->key != y.a->key ? x.a->key < y.a->key : x.b->key < y.b->key;
+        });
+        if (out.size() > limit) out.resize(limit);
+        return out;
+    }
+
+private:
+    struct PairKey {
+        int distance;
+        std::string low; // the lower of the two keys
+        std::string high;
+
+        bool operator<(const PairKey& o) const {
+            if (distance != o.distance) return distance < o.distance;
+            return low != o.low ? low < o.low : high < o.high;
+        }
+    };
+
+    static PairKey pair_key(const std::string& a, const std::string& b, int d) {
+        return a < b ? PairKey{d, a, b} : PairKey{d, b, a};
+    }
+
+    static std::string normalize(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (std::isalnum(u) || u >= 0x80) {
+                out += static_cast<char>(std::tolower(u));
+            } else if (!out.empty() && out.back() != ' ') {
+                out += ' ';
+            }
+        }
+        if (!out.empty() && out.back() == ' ') out.pop_back();
+        return out;
+    }
+
+    static uint64_t fnv1a(const char* data, size_t len) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < len; i++) {
+            h ^= static_cast<uint8_t>(data[i]);
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+    // splitmix64 finaliser, so nearby FNV values spread over all 64 bits.
+    static uint64_t mix(uint64_t h) {
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+    static uint8_t block(uint64_t fingerprint, int b) { return static_cast<uint8_t>(fingerprint >> (BLOCK_BITS * b)); }
+
+    template <typename Fn>
+    void probe(const Entry& e, int max_distance, Fn fn) const {
+        for (int b = 0; b < BLOCKS; b++) {
+            auto bucket = tables_[b].find(block(e.fingerprint, b));
+            if (bucket == tables_[b].end()) continue;
+            for (const auto& key : bucket->second) {
+                const Entry& other = entries_[positions_.at(key)];
+                if (&other == &e) continue;
+                // Only count the pair from the first block both agree on.
+                bool earlier = false;
+                for (int p = 0; p < b && !earlier; p++) earlier = block(other.fingerprint, p) == block(e.fingerprint, p);
+                int d = distance(e.fingerprint, other.fingerprint);
+                if (!earlier && d <= max_distance) fn(other, d);
+            }
+        }
+    }
+
+    // The entry, its positions_ slot and its key in one bucket per block.
+    static size_t entry_bytes(const Entry& e) {
+        return sizeof(Entry) + memory::heap_bytes(e.key) + memory::heap_bytes(e.group) +
+               memory::HASH_NODE_BYTES + memory::string_bytes(e.key) + sizeof(size_t) +
+               BLOCKS * memory::string_bytes(e.key);
+    }
+
+    // The pairs_ node plus each key's copy in the other entry's neighbours.
+    static size_t pair_bytes(const PairKey& p) {
+        return memory::TREE_NODE_BYTES + sizeof(PairKey) + memory::heap_bytes(p.low) + memory::heap_bytes(p.high) +
+               memory::string_bytes(p.low) + memory::string_bytes(p.high);
+    }
+
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, size_t> positions_;
+    std::array<std::unordered_map<uint8_t, std::vector<std::string>>, BLOCKS> tables_;
+    std::set<PairKey> pairs_; // every pair within MAX_DISTANCE
+    size_t bytes_ = 0;
+};
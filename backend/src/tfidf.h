@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memory.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// TF-IDF document vectors for cosine-similarity search. Terms are hashed
+// into DIMS signed buckets (the hashing trick), and each vector is
+// L2-normalised and quantised to int8, so comparing two documents is one
+// fixed-length integer dot product. Term counts are maintained
+// incrementally; a document's vector is rebuilt only after its text
+// changes, or for every document once the corpus size has drifted enough
+// to move the IDF weights.
+class TfIdfIndex {
+public:
+    static const int DIMS = 2048;
+
+    struct Match {
+        std::string doc;
+        double similarity; // approximate cosine similarity in [-1, 1]
+    };
+
+    void add_text(const std::string& doc, const std::string& text) { update(doc, text, 1); }
+    void remove_text(const std::string& doc, const std::string& text) { update(doc, text, -1); }
+
+    void remove_doc(const std::string& doc) {
+        auto it = docs_.find(doc);
+        if (it == docs_.end()) {
+            return;
+        }
+        for (const auto& term : it->second.tf) {
+            bytes_ -= term_bytes(term.first);
+            auto df = df_.find(term.first);
+            if (df != df_.end() && --df->second == 0) {
+                bytes_ -= term_bytes(term.first);
+                df_.erase(df);
+            }
+        }
+        bytes_ -= doc_bytes(doc);
+        docs_.erase(it);
+    }
+
+    size_t size() const { return docs_.size(); }
+
+    // Estimated heap footprint, kept current as text is added and removed.
+    size_t memory_bytes() const { return bytes_; }
+
+    // The k documents most similar to doc, best first. Documents with no
+    // terms in common (similarity <= 0) are left out.
+    std::vector<Match> top_k(const std::string& doc, size_t k) {
+        std::vector<Match> out;
+        refresh();
+        auto target = docs_.find(doc);
+        if (target == docs_.end()) {
+            return out;
+        }
+        const Doc& t = target->second;
+        for (const auto& other : docs_) {
+            if (other.first == doc) continue;
+            double similarity = dot(t.vec.data(), other.second.vec.data()) * t.scale * other.second.scale;
+            if (similarity > 0) out.push_back({other.first, similarity});
+        }
+        size_t keep = std::min(k, out.size());
+        std::partial_sort(out.begin(), out.begin() + keep, out.end(),
+                          [](const Match& a, const Match& b) { return a.similarity > b.similarity; });
+        out.resize(keep);
+        return out;
+    }
+
+    // Sum of a[i] * b[i] over DIMS int8 lanes.
+    static int32_t dot(const int8_t* a, const int8_t* b) {
+#if defined(__AVX2__)
+        __m256i acc = _mm256_setzero_si256();
+        for (int i = 0; i < DIMS; i += 16) {
+            __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+            __m256i y = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(sum);
+#elif defined(__SSE2__)
+        // No sign-extending load before SSE4.1: interleave each byte with
+        // itself and shift right arithmetically to widen to int16.
+        __m128i acc = _mm_setzero_si128();
+        for (int i = 0; i < DIMS; i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            __m128i x_lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+            __m128i x_hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+            __m128i y_lo = _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8);
+            __m128i y_hi = _mm_srai_epi16(_mm_unpackhi_epi8(y, y), 8);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(x_lo, y_lo));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(x_hi, y_hi));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(acc);
+#else
+        int32_t sum = 0;
+        for (int i = 0; i < DIMS; i++) sum += int32_t(a[i]) * int32_t(b[i]);
+        return sum;
+#endif
+    }
+
+private:
+    struct Doc {
+        std::unordered_map<std::string, uint32_t> tf;
+        bool dirty = true;
+        float scale = 0; // vec[i] * scale approximates the unit vector
+        std::array<int8_t, DIMS> vec{};
+    };
+
+    // Lowercase alphanumeric words of two or more characters.
+    static std::vector<std::string> tokenize(const std::string& text) {
+        std::vector<std::string> terms;
+        std::string term;
+        for (size_t i = 0; i <= text.size(); i++) {
+            unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+            if (std::isalnum(c) || c >= 0x80) {
+                term += static_cast<char>(std::tolower(c));
+            } else {
+                if (term.size() >= 2) terms.push_back(term);
+                term.clear();
+            }
+        }
+        return terms;
+    }
+
+    static uint64_t hash(const std::string& term) {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (char c : term) {
+            h ^= static_cast<uint8_t>(c);
+            h *= 0x100000001b3ULL;
+        }
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        return h ^ (h >> 31);
+    }
+
+    static size_t doc_bytes(const std::string& doc) {
+        return memory::HASH_NODE_BYTES + memory::string_bytes(doc) + sizeof(Doc);
+    }
+
+    // One entry in a document's tf map or in df_.
+    static size_t term_bytes(const std::string& term) {
+        return memory::HASH_NODE_BYTES + memory::string_bytes(term) + sizeof(uint32_t);
+    }
+
+    void update(const std::string& doc, const std::string& text, int delta) {
+        auto slot = docs_.emplace(doc, Doc());
+        if (slot.second) bytes_ += doc_bytes(doc);
+        Doc& d = slot.first->second;
+        for (const auto& term : tokenize(text)) {
+            auto tf = d.tf.find(term);
+            if (delta > 0) {
+                if (tf == d.tf.end()) {
+                    d.tf.emplace(term, 1);
+                    bytes_ += term_bytes(term);
+                    if (df_[term]++ == 0) bytes_ += term_bytes(term);
+                } else {
+                    tf->second++;
+                }
+            } else if (tf != d.tf.end() && --tf->second == 0) {
+                d.tf.erase(tf);
+                bytes_ -= term_bytes(term);
+                auto df = df_.find(term);
+                if (df != df_.end() && --df->second == 0) {
+                    bytes_ -= term_bytes(term);
+                    df_.erase(df);
+                }
+            }
+        }
+        d.dirty = true;
+    }
+
+    void refresh() {
+        // IDF weights move with the corpus size; re-weight everything once it
+        // has changed by more than a tenth since the last full rebuild.
+        size_t n = docs_.size();
+        bool all = idf_docs_ == 0 || n * 10 > idf_docs_ * 11 || n * 10 < idf_docs_ * 9;
+        if (all) idf_docs_ = std::max<size_t>(n, 1);
+        for (auto& doc : docs_) {
+            if (all || doc.second.dirty) vectorize(doc.second);
+        }
+    }
+
+    void vectorize(Doc& d) {
+        std::array<float, DIMS> v{};
+        for (const auto& term : d.tf) {
+            auto df = df_.find(term.first);
+            double idf = std::log((1.0 + idf_docs_) / (1.0 + (df == df_.end() ? 0 : df->second))) + 1.0;
+            double weight = (1.0 + std::log(double(term.second))) * idf;
+            uint64_t h = hash(term.first);
+            v[h % DIMS] += (h >> 63) ? -weight : weight;
+        }
+
+        double norm = 0, max_abs = 0;
+        for (float x : v) {
+            norm += double(x) * x;
+            max_abs = std::max(max_abs, double(std::fabs(x)));
+        }
+        d.vec.fill(0);
+        d.scale = 0;
+        if (norm > 0) {
+            norm = std::sqrt(norm);
+            double step = max_abs / norm / 127.0;
+            for (int i = 0; i < DIMS; i++) d.vec[i] = static_cast<int8_t>(std::lround(v[i] / norm / step));
+            d.scale = static_cast<float>(step);
+        }
+        d.dirty = false;
+    }
+
+    std::unordered_map<std::string, Doc> docs_;
+    std::unordered_map<std::string, uint32_t> df_;
+    size_t idf_docs_ = 0;
+    size_t bytes_ = 0;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Hierarchical timer wheel with one-second ticks. Level 0 covers the next 64
+// ticks, each higher level 64x the span of the one below it; entries cascade
+// down a level when the wheel reaches the start of their block, so advancing
+// costs O(expired entries) rather than a scan of everything scheduled.
+//
+// Not thread-safe: callers serialize schedule() and advance().
+template <typename T>
+class TimerWheel {
+public:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    explicit TimerWheel(int64_t now) : now_(now) {}
+
+    int64_t now() const { return now_; }
+
+    void schedule(int64_t when, T item) {
+        if (when <= now_) {
+            when = now_ + 1;
+        }
+        place(when, std::move(item));
+    }
+
+    // Moves the wheel forward to `now`, calling fire(item) for every entry
+    // whose deadline has passed.
+    template <typename Fn>
+    void advance(int64_t now, Fn fire) {
+        while (now_ < now) {
+            now_++;
+            for (int level = LEVELS - 1; level > 0; level--) {
+                int64_t below = now_ & ((int64_t(1) << (SLOT_BITS * level)) - 1);
+                if (below == 0) {
+                    cascade(level, static_cast<size_t>(now_ >> (SLOT_BITS * level)) & (SLOTS - 1));
+                }
+            }
+
+            std::vector<std::pair<int64_t, T>> due;
+            due.swap(slots_[0][now_ & (SLOTS - 1)]);
+            for (auto& entry : due) {
+                if (entry.first <= now_) {
+                    fire(entry.second);
+                } else {
+                    schedule(entry.first, std::move(entry.second));
+                }
+            }
+        }
+    }
+
+private:
+    // Files an entry under the lowest level whose block contains both now_
+    // and `when`. Entries due exactly now land in the current level-0 slot,
+    // which advance() drains right after cascading.
+    void place(int64_t when, T item) {
+        int level = 0;
+        while (level < LEVELS - 1 && (when >> (SLOT_BITS * (level + 1))) != (now_ >> (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        size_t slot = static_cast<size_t>(when >> (SLOT_BITS * level)) & (SLOTS - 1);
+        slots_[level][slot].emplace_back(when, std::move(item));
+    }
+
+    void cascade(int level, size_t slot) {
+        std::vector<std::pair<int64_t, T>> entries;
+        entries.swap(slots_[level][slot]);
+        for (auto& entry : entries) {
+            place(entry.first, std::move(entry.second));
+        }
+    }
+
+    int64_t now_;
+    std::vector<std::pair<int64_t, T>> slots_[LEVELS][SLOTS];
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "logger.h"
+
+// Request-phase tracing. Spans are recorded into a thread-local buffer while
+// a request runs (two clock reads and a vector push each, no locks); when
+// the request finishes the trace is kept if it was sampled (1 in
+// sample_every) or ran longer than slow_us, and dropped otherwise. Kept
+// traces are rendered as Chrome trace-event "complete" events and appended
+// to a local file by flush(), so the file opens directly in chrome://tracing
+// or Perfetto. The closing ']' is left off, which the format allows, so the
+// file can be appended to across restarts.
+namespace tracing {
+
+struct Options {
+    std::string file = "trace.json";
+    uint64_t sample_every = 0; // 0 keeps only slow requests
+    uint64_t slow_us = 500000; // 0 disables slow-request capture
+    size_t max_pending = 65536; // events buffered between flushes
+};
+
+namespace detail {
+
+struct SpanRecord {
+    const char* name;
+    int64_t start_us;
+    int64_t duration_us;
+};
+
+struct Context {
+    bool active = false;
+    std::string trace_id;
+    int64_t start_us = 0;
+    int64_t routed_us = 0; // when the pre-routing handler returned
+    std::vector<SpanRecord> spans;
+};
+
+inline Context& context() {
+    thread_local Context c;
+    return c;
+}
+
+inline int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline int thread_number() {
+    static std::atomic<int> next{1};
+    thread_local int id = next++;
+    return id;
+}
+
+inline void append_escaped(std::string& out, const std::string& s) {
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+} // namespace detail
+
+// Trace id of the request on this thread (empty outside requests).
+inline const std::string& current_trace_id() { return detail::context().trace_id; }
+
+// Times the enclosing scope as a child of the current request's trace; a
+// no-op on threads with no request in flight.
+class Span {
+public:
+    explicit Span(const char* name) : name_(name), active_(detail::context().active) {
+        if (active_) start_us_ = detail::now_us();
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span() { end(); }
+
+    void end() {
+        if (!active_) return;
+        active_ = false;
+        detail::Context& ctx = detail::context();
+        if (ctx.active) ctx.spans.push_back({name_, start_us_, detail::now_us() - start_us_});
+    }
+
+private:
+    const char* name_;
+    bool active_;
+    int64_t start_us_ = 0;
+};
+
+class Tracer {
+public:
+    // Also fixes this run's time base: span times are steady_clock, shifted
+    // to wall-clock microseconds, and pid is the process id, so runs
+    // appended to the same file line up after each other in the viewer.
+    void configure(Options options) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        options_ = std::move(options);
+        epoch_offset_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::system_clock::now().time_since_epoch()).count() - detail::now_us();
+        pid_ = static_cast<int>(getpid());
+    }
+
+    // A fresh 64-bit id, or the caller's id when it is a usable token, so a
+    // client or proxy can correlate its own logs with ours.
+    static std::string trace_id(const std::string& incoming) {
+        if (!incoming.empty() && incoming.size() <= 64) {
+            bool ok = true;
+            for (char c : incoming) ok = ok && (std::isalnum(static_cast<unsigned char>(c)) || c == '-');
+            if (ok) return incoming;
+        }
+        thread_local std::mt19937_64 rng(std::random_device{}());
+        char buf[17];
+        std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(rng()));
+        return buf;
+    }
+
+    void begin_request(std::string trace_id) {
+        detail::Context& ctx = detail::context();
+        ctx.active = true;
+        ctx.trace_id = std::move(trace_id);
+        ctx.spans.clear();
+        ctx.start_us = detail::now_us();
+        ctx.routed_us = 0;
+    }
+
+    // Marks the end of pre-routing; route_matched() closes the span covering
+    // httplib's route lookup from there to the handler.
+    void pre_routing_done() { detail::context().routed_us = detail::now_us(); }
+
+    void route_matched() {
+        detail::Context& ctx = detail::context();
+        if (!ctx.active || !ctx.routed_us) return;
+        int64_t now = detail::now_us();
+        ctx.spans.push_back({"route_match", ctx.routed_us, now - ctx.routed_us});
+        ctx.routed_us = 0;
+    }
+
+    // Closes the request's root span and keeps or drops the trace.
+    void end_request(const std::string& name, const std::string& path, int status) {
+        detail::Context& ctx = detail::context();
+        if (!ctx.active) return;
+        ctx.active = false;
+        int64_t duration_us = detail::now_us() - ctx.start_us;
+        bool sampled = options_.sample_every && requests_.fetch_add(1, std::memory_order_relaxed) % options_.sample_every == 0;
+        bool slow = options_.slow_us && static_cast<uint64_t>(duration_us) >= options_.slow_us;
+        if (!sampled && !slow) return;
+
+        int tid = detail::thread_number();
+        std::string events;
+        append_event(events, name.c_str(), ctx.start_us, duration_us, tid, &ctx, &path, status);
+        for (const auto& span : ctx.spans) {
+            append_event(events, span.name, span.start_us, span.duration_us, tid, &ctx, nullptr, 0);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t count = ctx.spans.size() + 1;
+        if (pending_count_ + count > options_.max_pending) {
+            dropped_++;
+            return;
+        }
+        pending_ += events;
+        pending_count_ += count;
+    }
+
+    // Appends buffered events to the trace file. Called once a second from
+    // the maintenance thread.
+    void flush() {
+        std::string events;
+        std::string file;
+        uint64_t dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events.swap(pending_);
+            pending_count_ = 0;
+            dropped = dropped_;
+            dropped_ = 0;
+            file = options_.file;
+        }
+        if (dropped) logging::warn("trace_requests_dropped").num("count", dropped);
+        if (events.empty()) return;
+
+        std::ofstream out(file, std::ios::app | std::ios::binary);
+        if (!out) {
+            logging::error("trace_write_failed").str("file", file);
+            return;
+        }
+        out.seekp(0, std::ios::end);
+        // Every event starts with ",\n"; the first one in the file gets "["
+        // in place of the comma.
+        if (out.tellp() == 0) events[0] = '[';
+        out << events;
+    }
+
+private:
+    void append_event(std::string& out, const char* name, int64_t start_us, int64_t duration_us, int tid,
+                      const detail::Context* ctx, const std::string* path, int status) const {
+        out += ",\n{\"name\":\"";
+        detail::append_escaped(out, name);
+        out += "\",\"cat\":\"";
+        out += path ? "request" : "phase";
+        out += "\",\"ph\":\"X\",\"pid\":" + std::to_string(pid_) + ",\"tid\":" + std::to_string(tid) +
+               ",\"ts\":" + std::to_string(start_us + epoch_offset_us_) + ",\"dur\":" + std::to_string(duration_us) +
+               ",\"args\":{\"trace_id\":\"" + ctx->trace_id + "\"";
+        if (path) {
+            out += ",\"path\":\"";
+            detail::append_escaped(out, *path);
+            out += "\",\"status\":" + std::to_string(status);
+        }
+        out += "}}";
+    }
+
+    Options options_; // written before the server starts; read without the lock
+    int64_t epoch_offset_us_ = 0; // likewise
+    int pid_ = 1;
+    std::atomic<uint64_t> requests_{0};
+    std::mutex mutex_; // guards the fields below
+    std::string pending_;
+    size_t pending_count_ = 0;
+    uint64_t dropped_ = 0;
+};
+
+} // namespace tracing
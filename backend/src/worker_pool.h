@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads in front of a queue with a hard depth limit.
+// try_submit() refuses work instead of queueing it once the limit is reached,
+// so callers can shed load (503) rather than letting latency grow unbounded.
+class BoundedWorkerPool {
+public:
+    BoundedWorkerPool(size_t threads, size_t max_queued) : max_queued_(max_queued) {
+        for (size_t i = 0; i < threads; i++) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    BoundedWorkerPool(const BoundedWorkerPool&) = delete;
+    BoundedWorkerPool& operator=(const BoundedWorkerPool&) = delete;
+
+    ~BoundedWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shutdown_ = true;
+        }
+        cond_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    bool try_submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (shutdown_ || jobs_.size() >= max_queued_) {
+                return false;
+            }
+            jobs_.push_back(std::move(job));
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    size_t queued() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return jobs_.size();
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this] { return shutdown_ || !jobs_.empty(); });
+                if (shutdown_ && jobs_.empty()) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    size_t max_queued_;
+    bool shutdown_ = false;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
@@ -15,7 +15,7 @@ const Auth = ({ apiCall, onLogin }) => {
             const data = await apiCall(endpoint, 'POST', { username, password });
             
             if (isLogin) {
-                onLogin(data.user_id); 
+                onLogin(data.token); 
             } else {
                 setMessage('Registration successful! Please log in.');
                 setIsLogin(true);
@@ -79,6 +79,12 @@ const Dashboard = ({ apiCall, navigateToEditor, navigateToQuiz, user, sets, setS
                             <h4>{set.title}</h4>
                             <p className="set-description">{set.description}</p>
                             <p>{set.card_count} cards</p>
+                            {set.tags && set.tags.length > 0 && (
+                                <p className="set-tags">{set.tags.map(tag => `#${tag}`).join(' ')}</p>
+                            )}
+                            {set.last_studied > 0 && (
+                                <p>{Math.round(set.mastery)}% mastered · {set.due_count} due</p>
+                            )}
                         </div>
                     ))}
                 </div>
@@ -1,4 +1,4 @@
-import React, { useState, useEffect } from 'react';
+import React, { useState, useEffect, useRef } from 'react';
 
 const Quiz = ({ set, navigateToDashboard, apiCall }) => {
     const [currentIndex, setCurrentIndex] = useState(0);
@@ -8,6 +8,12 @@ const Quiz = ({ set, navigateToDashboard, apiCall }) => {
     const [incorrectCards, setIncorrectCards] = useState([]);
     const [currentQuizCards, setCurrentQuizCards] = useState(set.cards);
     const [responseState, setResponseState] = useState(null); 
+    const [results, setResults] = useState([]);
+    const cardShownAt = useRef(Date.now());
+
+    useEffect(() => {
+        cardShownAt.current = Date.now();
+    }, [currentIndex, currentQuizCards]);
 
     useEffect(() => {
         if (set.cards.length > 0 && currentQuizCards.length === 0) {
@@ -21,6 +27,14 @@ const Quiz = ({ set, navigateToDashboard, apiCall }) => {
         }
     }, [currentIndex, currentQuizCards.length]);
 
+    useEffect(() => {
+        if (quizFinished && results.length > 0) {
+            apiCall('/stats', 'POST', { set_id: set.set_id, results })
+                .catch(e => console.error(`Failed to save quiz stats: ${e.message}`));
+            setResults([]);
+        }
+    }, [quizFinished]);
+
     if (set.cards.length === 0 && !quizFinished) { 
         return (
             <div style={{ padding: '40px', textAlign: 'center' }}>
@@ -96,6 +110,9 @@ const Quiz = ({ set, navigateToDashboard, apiCall }) => {
             [isCorrect ? 'correct' : 'incorrect']: prev[isCorrect ? 'correct' : 'incorrect'] + 1
         }));
 
+        const latencyMs = Date.now() - cardShownAt.current;
+        setResults(prev => [...prev, { card_id: currentCard.card_id, correct: isCorrect, latency_ms: latencyMs }]);
+
         if (!isCorrect) {
             setIncorrectCards(prev => {
                 if (!prev.includes(currentCard)) {